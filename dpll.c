@@ -3,18 +3,44 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <limits.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_BZLIB
+#include <bzlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #define ereport(err_msg) \
 do { \
 	if (errno != 0) perror((err_msg)); \
-	else if (printf("%s\n", (err_msg)) < 0) perror("Ereport failed"); \
+	else if (fprintf(stderr, "%s\n", (err_msg)) < 0) \
+		perror("Ereport failed"); \
 } while (0)
 
 #define ereport_and_exit(err_msg, return_val) \
 do { \
 	if (errno != 0) perror((err_msg)); \
-	else if (printf("Internal error: %s\n", (err_msg)) < 0) \
+	else if (fprintf(stderr, "Internal error: %s\n", (err_msg)) < 0) \
 		perror("Ereport failed"); \
 	return (return_val); \
 } while (0)
@@ -26,706 +52,6156 @@ typedef enum AssignedValue
 	VAL_TRUE = 1,
 }		AssignedValue;
 
-typedef struct Clause Clause;
+/*
+ * Clauses are stored in a single arena and addressed by their offsets in it,
+ * counted in 32-bit words. References stay valid when the arena grows, unlike
+ * pointers to clauses, which must not be kept across allocations.
+ */
+typedef unsigned int ClauseRef;
+
+#define InvalidClauseRef	UINT_MAX
+
+/*
+ * List of clauses which are currently watching some literal. Two literals of
+ * each clause are watched: while both of them are not false, clause can be
+ * neither unit nor empty, so we don't need to visit it at all.
+ */
+typedef struct WatchList
+{
+	ClauseRef		*clauses;
+	unsigned int	nclauses;
+	unsigned int	capacity;
+}		WatchList;
 
 typedef struct Variable
 {
 	unsigned int name;
 	AssignedValue	assigned_value;
 	unsigned int	nrelated_clauses;
-	Clause 			**related_clauses;
-}		Variable;
+	ClauseRef		*related_clauses;
 
-typedef struct Literal
-{
-	Variable		*variable;
-	bool			is_negated;
-	unsigned int	stack_depth;
-}		Literal;
+	/*
+	 * Clauses watching literals of this variable. Index 0 is for the positive
+	 * literal and index 1 is for the negated one, so it can be addressed by
+	 * the sign bit of Literal.
+	 */
+	WatchList		watches[2];
 
-#define LiteralGivesTrue(literal_ptr) \
-	(((literal_ptr)->variable->assigned_value == VAL_FALSE && \
-	  (literal_ptr)->is_negated) || \
-	 ((literal_ptr)->variable->assigned_value == VAL_TRUE && \
-	  !(literal_ptr)->is_negated))
+	/*
+	 * Decision level at which variable was assigned, and the clause which
+	 * became unit and implied the value (InvalidClauseRef for decisions).
+	 * Both are valid only while variable is assigned.
+	 */
+	unsigned int	level;
+	ClauseRef		reason;
 
-#define InvalidLiteralName	0
+	/* Used by conflict analysis, false otherwise */
+	bool			seen;
+
+	/* How often variable participated in conflicts recently (VSIDS) */
+	double			activity;
+
+	/*
+	 * Value to try first when variable is chosen for a decision. Set by the
+	 * initial phase policy and, with phase saving, to the last value variable
+	 * had. VAL_UNASSIGNED lets the decision heuristic choose.
+	 */
+	AssignedValue	phase;
+}		Variable;
 
 /*
- * We assume that there cannot be more than 150 variables. Thus, CHAR_MAX
- * value can be occupied by a flag.
+ * Literal is encoded as 2 * variable index + sign, where variable index is
+ * (name - 1) and sign is 1 for the negated literal.
  */
-#define InvalidStackDepth	UINT_MAX
+typedef unsigned int Literal;
 
-#define LiteralIsInUse(literal_ptr) \
-	((literal_ptr)->stack_depth == InvalidStackDepth)
+/*
+ * Limits of the formula size. Both literals and counts per literal must fit
+ * into an int.
+ */
+#define MAX_VARIABLES	(INT_MAX / 2)
+#define MAX_CLAUSES		(INT_MAX - 1)
 
-#define LiteralSetUnused(literal_ptr, stack_d) \
-do { \
-	(literal_ptr)->stack_depth = (stack_d); \
-} while (0)
+#define MakeLiteral(var_idx, is_negated)	(2 * (var_idx) + (is_negated))
+#define LiteralVarIdx(literal)				((literal) >> 1)
+#define LiteralIsNegated(literal)			((literal) & 1)
 
-#define LiteralSetUsed(literal_ptr) \
-do { \
-	(literal_ptr)->stack_depth = (InvalidStackDepth); \
-} while (0)
+#define LiteralVariable(formula, literal) \
+	(&(formula)->variables[LiteralVarIdx(literal)])
+
+/* VAL_FALSE and VAL_TRUE are 0 and 1, so they are compared with the sign */
+#define LiteralGivesTrue(formula, literal) \
+	(LiteralVariable(formula, literal)->assigned_value == \
+	 (AssignedValue) !LiteralIsNegated(literal))
+
+#define LiteralGivesFalse(formula, literal) \
+	(LiteralVariable(formula, literal)->assigned_value == \
+	 (AssignedValue) LiteralIsNegated(literal))
+
+#define LiteralIsUnassigned(formula, literal) \
+	(LiteralVariable(formula, literal)->assigned_value == VAL_UNASSIGNED)
+
+#define LiteralWatchList(formula, literal) \
+	(&LiteralVariable(formula, literal)->watches[LiteralIsNegated(literal)])
+
+#define InvalidLiteralName	0
 
+/*
+ * Header of a clause in the arena, followed by its literals. Literals at
+ * positions 0 and 1 are the watched ones. Clauses with single literal watch
+ * only the first one.
+ */
 typedef struct Clause
 {
-	Literal		*literals;
 	int			n_literals;
-	int			n_in_use;
+
+	union
+	{
+		/*
+		 * Number of true literals. Maintained only for clauses of the formula
+		 * itself and only while dynamic literal counts are used for decisions.
+		 */
+		int			n_true;
+
+		/* New place of a learned clause while the arena is compacted */
+		ClauseRef	moved_to;
+	};
+
+	/* Fields below are used only for learned clauses */
+	float		activity;
+	unsigned int lbd : 27;
+	unsigned int tier : 2;
+	unsigned int learnt : 1;
+	unsigned int used : 1;		/* participated in conflict since last reduction */
+	unsigned int deleted : 1;
+
+	Literal		literals[];
 }		Clause;
 
+#define CLAUSE_MAX_LBD		((1U << 27) - 1)
+
+/* Size of the clause with 'n' literals in the arena, in 32-bit words */
+#define ClauseWords(n) \
+	((sizeof(Clause) + sizeof(Literal) * (n)) / sizeof(unsigned int))
+
+#define ClauseAt(formula, ref) \
+	((Clause *) ((formula)->arena.data + (ref)))
+
+typedef struct ClauseArena
+{
+	unsigned int	*data;
+	unsigned int	size;		/* words in use */
+	unsigned int	capacity;
+}		ClauseArena;
+
+/*
+ * Learned clauses are kept according to their tier. Core clauses are never
+ * deleted, tier2 ones are kept while they are used and moved to local tier
+ * otherwise. Local clauses with least activity are deleted on each reduction.
+ */
+#define TIER_CORE			0
+#define TIER_2				1
+#define TIER_LOCAL			2
+
+#define TIER_CORE_MAX_LBD	2
+#define TIER_2_MAX_LBD		6
+
+#define ClauseTier(lbd) \
+	((lbd) <= TIER_CORE_MAX_LBD ? TIER_CORE : \
+	 (lbd) <= TIER_2_MAX_LBD ? TIER_2 : TIER_LOCAL)
+
+/* Learned clauses are reduced each time after this many more conflicts */
+#define REDUCE_FIRST_INTERVAL		2000
+#define REDUCE_INTERVAL_INCREMENT	300
+
+#define CLAUSE_ACTIVITY_DECAY		0.999
+#define CLAUSE_RESCALE_LIMIT		1e20
+
+/*
+ * Occurrences of a literal in clauses of the formula. 'freq' counts all such
+ * clauses, 'short_freq' only those of the size MOMS looks at, and 'weight'
+ * sums 2^-size over them. Clause sizes are the original ones.
+ *
+ * With dynamic counts only clauses, that are not satisfied yet, are taken
+ * into account. Table has two entries per variable: for the positive literal
+ * and for the negated one.
+ */
 typedef struct LiteralFrequency
 {
-	unsigned int lname;
 	int			 freq;
+	int			 short_freq;
+	double		 weight;
 }		LiteralFrequency;
 
+/* Literal encoding matches the layout of the table */
+#define LiteralFrequencyIndex(literal)	(literal)
+
+typedef enum DecisionHeuristic
+{
+	HEURISTIC_FIRST = 1,	/* first unassigned variable by index */
+	HEURISTIC_VSIDS = 2,	/* most active variable in recent conflicts */
+	HEURISTIC_DLIS = 3,		/* literal occurring in most clauses */
+	HEURISTIC_MOMS = 4,		/* most occurrences in clauses of minimum size */
+	HEURISTIC_JW = 5,		/* two-sided Jeroslow-Wang */
+}		DecisionHeuristic;
+
+/* Weight of the occurrences sum in MOMS score: (f(x) + f(-x)) * 2^k + f(x) * f(-x) */
+#define MOMS_FACTOR			1024.0
+
+/*
+ * Binary max-heap of variable indices ordered by activity. Assigned variables
+ * may stay in the heap, they are skipped when popped.
+ */
+typedef struct VariableHeap
+{
+	unsigned int	*data;
+	int				*position;	/* index in 'data' for each variable or -1 */
+	unsigned int	size;
+}		VariableHeap;
+
+/* Activity increment grows by 1/VSIDS_DECAY after each conflict */
+#define VSIDS_DECAY			0.95
+#define VSIDS_RESCALE_LIMIT	1e100
+
+typedef struct ProofWriter ProofWriter;
+typedef struct ClauseExchange ClauseExchange;
+typedef struct CubeQueue CubeQueue;
+typedef struct WorkSharing WorkSharing;
+
 typedef struct Formula
 {
 	/* List of all clauses within formula */
-	Clause		*clauses;
+	ClauseRef	*clauses;
 
 	/*
-	 * We don't want to call 'malloc' for each clause. So, we allocating memory
-	 * for literals and their values as a one big chuck. Thus, pointers in
-	 * Clause struct are only points to different places off arrays below.
+	 * We don't want to call 'malloc' for each clause. So, all clauses with
+	 * their literals are placed into the arena, and related clauses of all
+	 * variables are different places of a single array.
 	 */
+	ClauseArena		arena;
 	Variable		*variables;
 	LiteralFrequency	*lfrequency;
+	ClauseRef		*related_pool;
 
 	int				nclauses;
 	int				nvariables;
-	int				nliterals_total;
+	size_t			nliterals_total;
+
+	/*
+	 * Clauses derived during conflict analysis. They are placed in the arena
+	 * after clauses of the formula, in the order of this list.
+	 */
+	ClauseRef		*learnts;
+	int				nlearnts;
+	int				learnts_capacity;
+	double			clause_activity_inc;
+
+	/*
+	 * Learned and deleted clauses are logged here, if proof is requested.
+	 * LRAT proofs refer to clauses by their IDs, so they are kept for learned
+	 * clauses in the order of 'learnts'.
+	 */
+	ProofWriter		*proof;
+	unsigned long long *learnt_ids;
+
+	/*
+	 * Copies of the formula share the list of clauses of the original one,
+	 * since it never changes. 'parent' owns it.
+	 */
+	const struct Formula *parent;
+
+	/* Search stops, once this is set, if not NULL */
+	atomic_bool		*interrupt;
+
+	/* Learned clauses are shared with other solvers through it, if not NULL */
+	ClauseExchange	*exchange;
+
+	/* Search is limited to cubes taken from the queue, if not NULL */
+	CubeQueue		*cubes;
+
+	/* Subtrees of the DPLL search are stolen by other threads, if not NULL */
+	WorkSharing		*work;
+
+	/* Statistics of the search */
+	unsigned long long ndecisions;
+	unsigned long long nconflicts;
+	unsigned long long npropagations;
+
+	/* Buffer for the clause being learned, has an entry per variable */
+	Literal			*learnt_buf;
+
+	/*
+	 * Used to count distinct decision levels in a clause: level is counted if
+	 * its mark equals to the current stamp. Has an entry per level.
+	 */
+	unsigned int	*level_marks;
+	unsigned int	level_stamp;
+
+	DecisionHeuristic heuristic;
+	VariableHeap	order;
+	double			activity_inc;
+
+	/*
+	 * Literal counts are computed once, if true. Otherwise they are updated
+	 * on each assignment and its reverting.
+	 */
+	bool			static_counts;
+
+	/*
+	 * Size of clauses counted in 'short_freq' for MOMS. With dynamic counts
+	 * it follows the minimum size of clauses, that are not satisfied yet:
+	 * their number for each size up to 'max_clause_size' is kept in
+	 * 'unsatisfied_by_size'.
+	 */
+	int				short_clause_size;
+	int				max_clause_size;
+	int				*unsatisfied_by_size;
+
+	bool			phase_saving;
+
+	/* State of the pseudo-random generator (xorshift64*), must be non-zero */
+	unsigned long long random_state;
 }		Formula;
 
+typedef enum PhasePolicy
+{
+	PHASE_DEFAULT = 0,		/* decided by heuristic, VAL_TRUE if it cannot */
+	PHASE_TRUE = 1,
+	PHASE_FALSE = 2,
+	PHASE_RANDOM = 3,
+	PHASE_OCCURRENCE = 4,	/* polarity occurring in more clauses */
+}		PhasePolicy;
+
 static void
 drop_formula(Formula *formula)
 {
 	if (formula == NULL)
 		return;
 
-	for (int i = 0; i < formula->nclauses; i++)
-	{
-		if (formula->clauses[i].literals != NULL)
-			free(formula->clauses[i].literals);
-	}
-
 	for (int i = 0; i < formula->nvariables; i++)
 	{
-		if (formula->variables[i].related_clauses != NULL)
-			free(formula->variables[i].related_clauses);
+		for (int j = 0; j < 2; j++)
+		{
+			if (formula->variables[i].watches[j].clauses != NULL)
+				free(formula->variables[i].watches[j].clauses);
+		}
 	}
 
-	if (formula->clauses != NULL)
+	if (formula->clauses != NULL && formula->parent == NULL)
 		free(formula->clauses);
 
 	if (formula->variables != NULL)
 		free(formula->variables);
 
+	if (formula->arena.data != NULL)
+		free(formula->arena.data);
+
+	if (formula->related_pool != NULL)
+		free(formula->related_pool);
+
+	if (formula->learnts != NULL)
+		free(formula->learnts);
+
+	if (formula->learnt_ids != NULL)
+		free(formula->learnt_ids);
+
+	if (formula->learnt_buf != NULL)
+		free(formula->learnt_buf);
+
+	if (formula->level_marks != NULL)
+		free(formula->level_marks);
+
+	if (formula->order.data != NULL)
+		free(formula->order.data);
+
+	if (formula->order.position != NULL)
+		free(formula->order.position);
+
+	if (formula->lfrequency != NULL)
+		free(formula->lfrequency);
+
+	if (formula->unsatisfied_by_size != NULL)
+		free(formula->unsatisfied_by_size);
 
 	free(formula);
 }
 
-static void
-add_related_clause(Clause *c, Variable *v)
+/*
+ * Place a clause with 'n_literals' literals at the end of the arena. All
+ * fields except literals are set to their defaults. Pointers to clauses are
+ * invalidated, as the arena may be moved.
+ */
+static ClauseRef
+alloc_clause(Formula *formula, int n_literals)
 {
-	if (v->related_clauses == NULL)
-		v->related_clauses = (Clause **) malloc(sizeof(Clause *));
-	else
-		v->related_clauses = (Clause **)
-			realloc(v->related_clauses,
-					sizeof(Clause *) * (v->nrelated_clauses + 1));
+	ClauseArena *arena = &formula->arena;
+	unsigned int words = ClauseWords(n_literals);
+	ClauseRef	ref;
+	Clause		*c;
 
-	if (v->related_clauses == NULL)
+	if (arena->size + words > arena->capacity ||
+		arena->size + words < arena->size)
 	{
-		printf("cannot allocate memory for related clauses\n");
-		exit(1);
-	}
+		size_t capacity = (arena->capacity == 0) ? 1024 : arena->capacity;
 
-	v->related_clauses[v->nrelated_clauses] = c;
-	v->nrelated_clauses += 1;
-}
+		while (capacity < (size_t) arena->size + words)
+			capacity *= 2;
 
-static void
-add_related_literal(Clause *c, Literal l)
-{
-	if (c->literals == NULL)
-		c->literals = (Literal *) malloc(sizeof(Literal));
-	else
-		c->literals = (Literal *)
-			realloc(c->literals, sizeof(Literal) * (c->n_literals + 1));
+		/* References must not reach InvalidClauseRef */
+		if (capacity >= InvalidClauseRef)
+			capacity = InvalidClauseRef - 1;
 
-	if (c->literals == NULL)
-	{
-		printf("cannot allocate memory for related literals\n");
-		exit(1);
+		if ((size_t) arena->size + words > capacity)
+		{
+			printf("clause arena is full\n");
+			exit(1);
+		}
+
+		arena->data = (unsigned int *)
+			realloc(arena->data, sizeof(unsigned int) * capacity);
+		if (arena->data == NULL)
+		{
+			printf("cannot allocate memory for clauses\n");
+			exit(1);
+		}
+
+		arena->capacity = capacity;
 	}
 
-	c->literals[c->n_literals] = l;
-	c->n_literals += 1;
-	c->n_in_use += 1;
+	ref = arena->size;
+	arena->size += words;
+
+	c = ClauseAt(formula, ref);
+	c->n_literals = n_literals;
+	c->n_true = 0;
+	c->activity = 0.0;
+	c->lbd = 0;
+	c->tier = TIER_CORE;
+	c->learnt = false;
+	c->used = false;
+	c->deleted = false;
+
+	return ref;
 }
 
 /*
- * Read next value from DIMACS-formatted file.
- * Reutns 0 on eof, 1 on success.
+ * Space for related clauses of the variable is reserved beforehand.
  */
-static int
-read_next_val(FILE *file, int *val)
+static void
+add_related_clause(ClauseRef ref, Variable *v)
 {
-	while (true)
-	{
-		int rc = fscanf(file, "%d", val);
-
-		/* EOF or some another delimeter encountered */
-		if (feof(file) || rc != 1)
-			return 0;
-		/* All good - we read the value */
-		else
-			break;
-	}
+	/* Variable repeated within the clause, it is already related */
+	if (v->nrelated_clauses > 0 &&
+		v->related_clauses[v->nrelated_clauses - 1] == ref)
+		return;
 
-	return 1;
+	v->related_clauses[v->nrelated_clauses] = ref;
+	v->nrelated_clauses += 1;
 }
 
-
-static Formula *
-create_formula(FILE *file, int nclauses, int nvariables)
+/*
+ * Collect clauses of the formula related to each variable. Only dynamic
+ * literal counts need them, so every formula collects its own when such a
+ * heuristic is chosen. Returns false iff memory cannot be allocated.
+ */
+static bool
+collect_related_clauses(Formula *formula)
 {
-	Formula *formula;
-	Clause *c;
-	int		rc;
-	int val;
-	unsigned int current_clause = 0;
-
-	if ((formula = (Formula *) malloc(sizeof(Formula))) == NULL)
-		ereport_and_exit("Cannot allocate memory for Formula", NULL);
+	size_t	nrelated = 0;
 
-	if ((formula->clauses = (Clause *)
-			malloc(sizeof(Clause) * nclauses)) == NULL)
+	for (int i = 0; i < formula->nclauses; i++)
 	{
-		drop_formula(formula);
-		ereport_and_exit("Cannot allocate memory for Clauses", NULL);
-	}
+		Clause	*c = ClauseAt(formula, formula->clauses[i]);
 
-	for (int i = 0; i < nclauses; i++)
-	{
-		Clause c = {
-			.literals = NULL,
-			.n_literals = 0,
-			.n_in_use = 0,
-		};
-		formula->clauses[i] = c;
+		for (int j = 0; j < c->n_literals; j++)
+			LiteralVariable(formula, c->literals[j])->nrelated_clauses++;
 	}
 
-	if ((formula->variables = (Variable *)
-			malloc(sizeof(Variable) * nvariables)) == NULL)
+	if ((formula->related_pool = (ClauseRef *)
+			malloc(sizeof(ClauseRef) * (formula->nliterals_total + 1))) == NULL)
+		return false;
+
+	for (int i = 0; i < formula->nvariables; i++)
 	{
-		drop_formula(formula);
-		ereport_and_exit("Cannot allocate memory for literals", NULL);
+		Variable *v = &formula->variables[i];
+
+		v->related_clauses = formula->related_pool + nrelated;
+		nrelated += v->nrelated_clauses;
+		v->nrelated_clauses = 0;
 	}
 
-	for (unsigned int i = 0; i < nvariables; i++)
+	for (int i = 0; i < formula->nclauses; i++)
 	{
-		Variable v = {
-			.assigned_value = VAL_UNASSIGNED,
-			.name = i + 1,
-			.nrelated_clauses = 0,
-			.related_clauses = NULL,
-		};
-		formula->variables[i] = v;
-	}
+		ClauseRef ref = formula->clauses[i];
+		Clause	*c = ClauseAt(formula, ref);
 
-	/* Fill remaining fields */
-	formula->nclauses = nclauses;
-	formula->nvariables = nvariables;
+		for (int j = 0; j < c->n_literals; j++)
+			add_related_clause(ref, LiteralVariable(formula, c->literals[j]));
+	}
 
-	c = &formula->clauses[current_clause];
+	return true;
+}
 
-	while ((rc = read_next_val(file, &val)) == 1)
+static void
+add_watch(WatchList *wl, ClauseRef ref)
+{
+	if (wl->nclauses >= wl->capacity)
 	{
-		unsigned int lname = val > 0 ? val : val * (-1);
-		Literal l = {
-			.variable = &formula->variables[lname - 1],
-			.is_negated = (val < 0),
-			.stack_depth = InvalidStackDepth,
-		};
+		wl->capacity = (wl->capacity == 0) ? 4 : wl->capacity * 2;
+		wl->clauses = (ClauseRef *)
+			realloc(wl->clauses, sizeof(ClauseRef) * wl->capacity);
 
-		if (val == 0)
+		if (wl->clauses == NULL)
 		{
-			if (++current_clause >= nclauses)
-				break;
-
-			c = &formula->clauses[current_clause];
-			continue;
+			printf("cannot allocate memory for watch list\n");
+			exit(1);
 		}
-
-		add_related_clause(c, l.variable);
-		add_related_literal(c, l);
 	}
 
-	return formula;
+	wl->clauses[wl->nclauses++] = ref;
 }
 
-typedef enum AssignmentType
+/*
+ * Remove repeated literals from the clause. Returns false iff the clause is
+ * not to be watched: clauses containing both literal and its negation are
+ * always true, and empty ones have nothing to watch.
+ *
+ * 'marks' is a zeroed array with an entry per variable, it is left zeroed.
+ */
+static bool
+normalize_clause(Formula *formula, ClauseRef ref, signed char *marks)
 {
-	VAL_PROPAGATION = 1,
-	UNIT_PROPAGATION = 2,
-}		AssignmentType;
+	Clause	*c = ClauseAt(formula, ref);
+	bool	tautology = false;
+	int		n = 0;
 
-typedef struct Assignment
-{
-	AssignedValue	oldval;
-	AssignedValue	newval;
-	AssignmentType	type; /* type of an assignment */
-	unsigned int	literal_name;
-	unsigned int	stack_depth;
-}		Assignment;
+	for (int i = 0; i < c->n_literals; i++)
+	{
+		Literal		l = c->literals[i];
+		signed char	mark = LiteralIsNegated(l) ? -1 : 1;
+		signed char	*m = &marks[LiteralVarIdx(l)];
 
-typedef struct AssignmentStack
-{
-	Assignment		*data;
-	unsigned int	depth;
-	unsigned int	capacity;
-}		AssignmentStack;
+		if (*m == mark)
+			continue;
+		if (*m == -mark)
+			tautology = true;
 
-#define STACK_MAX_CAPACITY	1000
+		*m = mark;
+		c->literals[n++] = l;
+	}
 
-static void
-push(AssignmentStack *stack, Assignment *s)
-{
-	s->stack_depth = (stack->depth + 1);
+	for (int i = 0; i < n; i++)
+		marks[LiteralVarIdx(c->literals[i])] = 0;
 
-	if (stack->depth >= stack->capacity)
-	{
-		ereport("Assignment stack overflow");
-		exit(1);
-	}
+	c->n_literals = n;
 
-	stack->data[stack->depth++] = *s;
+	return !tautology && n > 0;
 }
 
-Assignment
-peek(AssignmentStack *stack)
+static void
+attach_clause(Formula *formula, ClauseRef ref)
 {
-	unsigned int depth = (stack->depth - 1);
-	return stack->data[depth];
+	Clause	*c = ClauseAt(formula, ref);
+
+	add_watch(LiteralWatchList(formula, c->literals[0]), ref);
+	if (c->n_literals > 1)
+		add_watch(LiteralWatchList(formula, c->literals[1]), ref);
 }
 
-Assignment
-pop(AssignmentStack *stack)
+/*
+ * Compressed input is recognized by magic bytes and decompressed on the fly.
+ * Each format is supported only if the solver is built with the respective
+ * library: -DHAVE_ZLIB -lz, -DHAVE_LZMA -llzma, -DHAVE_BZLIB -lbz2,
+ * -DHAVE_ZSTD -lzstd.
+ */
+typedef enum Compression
 {
-	return stack->data[--stack->depth];
-}
+	COMPRESSION_NONE = 0,
+	COMPRESSION_GZIP = 1,
+	COMPRESSION_XZ = 2,
+	COMPRESSION_BZIP2 = 3,
+	COMPRESSION_ZSTD = 4,
+}		Compression;
 
-static bool
-stack_is_empty(AssignmentStack *stack)
+/*
+ * Binary cache of a formula: header followed by 32-bit words of the formula
+ * as it is built from the DIMACS file. Each clause is stored as its number
+ * of literals followed by its literals in Literal encoding, repeated ones
+ * removed. Then watch lists follow in the order of Literal encoding, each as
+ * its length and references to clauses. Clauses are loaded into the arena
+ * one after another, so references are stored as they are after loading.
+ * The header and the words are in the byte order of the host, which has
+ * written them.
+ *
+ * Cache records device, inode, size and modification time of the DIMACS
+ * file it was made from, so it is not used for another file or once the
+ * file changes. Checksum is FNV-1a hash of the words.
+ */
+typedef struct CacheHeader
 {
-	return stack->depth == 0;
-}
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	byte_order;
+	int32_t		nvariables;
+	int32_t		nclauses;
+	uint64_t	nliterals;
+	uint64_t	nwatches;
+	uint64_t	checksum;
+	uint64_t	source_size;
+	int64_t		source_mtime_sec;
+	int64_t		source_mtime_nsec;
+	uint64_t	source_dev;
+	uint64_t	source_ino;
+}		CacheHeader;
+
+#define CACHE_MAGIC			"DPLLCNF"
+#define CACHE_VERSION		3
+#define CACHE_BYTE_ORDER	0x01020304
+
+#define FNV_OFFSET_BASIS	14695981039346656037ULL
+#define FNV_PRIME			1099511628211ULL
 
 /*
- * Returns non-zero value iff single line was readed.
+ * Buffers of a thread reading many files one after another. They are kept
+ * from file to file instead of being allocated for each of them.
  */
-static int
-readline(FILE *file)
+typedef struct ReaderBuffers
 {
-	char	next_symb = 'c';
+	void	   *block;		/* READ_BLOCK_SIZE bytes, NULL until needed */
+	void	   *in_block;	/* the same for compressed input */
+	int		   *vals;		/* values of clauses */
+	size_t		vals_capacity;
+}		ReaderBuffers;
 
-	while (next_symb != '\n' && next_symb != EOF)
-		next_symb = fgetc(file);
+/*
+ * Input of the DIMACS parser. Regular files are mapped into memory as a
+ * whole, others are read in blocks of READ_BLOCK_SIZE bytes. Either way the
+ * parser scans characters in [pos, end) and asks for more only when the
+ * buffer is exhausted.
+ *
+ * For compressed files the mapped file or the blocks read are the input of
+ * the decompressor, which fills the block buffer for the parser.
+ */
+typedef struct DimacsReader
+{
+	const char	*pos;
+	const char	*end;
 
-	/* Error occured */
-	if (next_symb == EOF)
-		return 0;
+	int			fd;
+	void		*map;		/* mapped file or NULL */
+	size_t		map_size;
+	char		*buf;		/* block buffer, if file is not mapped */
 
-	return 1;
-}
+	Compression	compression;
+	void		*stream;	/* state of the decompressor */
+	unsigned char *in_buf;	/* compressed block, if file is not mapped */
+	const unsigned char *in_pos;
+	const unsigned char *in_end;
+	bool		input_done;	/* no more compressed input to get */
+	bool		finished;	/* no more data for the parser */
+
+	/* Input is a cache file rather than DIMACS text */
+	bool		is_cache;
+	CacheHeader	cache;
+
+	/* Regular file being read, used to tell whether its cache is stale */
+	bool		is_regular;
+	struct stat	source;
+
+	/* If set, formula built from DIMACS text is written to this cache */
+	const char	*cache_path;
+
+	/* Threads parsing mapped text, 0 to use all online processors */
+	int			parse_threads;
+
+	size_t		nbytes;		/* bytes made available to the parser so far */
+
+	/* Buffers are taken from here and not freed, if not NULL */
+	ReaderBuffers *buffers;
+}		DimacsReader;
+
+#define READ_BLOCK_SIZE		(1 << 20)
 
 /*
- * Files in DIMACS format may contain comments - lines beginning with 'c'
- * literal. This function will skip them.
+ * Read up to 'size' bytes into 'dst', retrying until at least 'min' bytes are
+ * read. Pipes return data as soon as it is written, so parsing can go along
+ * with the writer instead of waiting for the whole block.
  *
- * Function returns non-zero value iff comments are skipped successfully.
+ * Returns number of bytes read, it is less than 'min' only at the end of
+ * input, or -1 on error.
  */
-static int
-skip_comments(FILE *file)
+static ssize_t
+read_block(int fd, void *dst, size_t size, size_t min)
 {
-	char	next_symb = 'c';
-	int		rc;
-
-	if (file == NULL)
-		ereport_and_exit("Invalid argument: file is NULL", 0);
+	size_t	total = 0;
 
-	while (!feof(file) && next_symb != 'p')
+	while (total < min)
 	{
-		if ((next_symb = fgetc(file)) == EOF)
-			ereport_and_exit("Cannot read from file", 0);
-
-		if (next_symb == 'c')
-		{
-			/*
-			 * Skip the line with a comment. We are expecting that whole line
-			 * is present, so exit if we cannot read it.
-			 */
-			if (!readline(file))
-				ereport_and_exit("Cannot read from file", 0);
+		ssize_t n = read(fd, (char *) dst + total, size - total);
 
+		if (n < 0 && errno == EINTR)
 			continue;
-		}
-		else if (next_symb != 'p')
-		{
-			/*
-			 * We are expecting only 'c' or 'p' literal at the beginning of
-			 * the line.
-			 */
-			ereport_and_exit("Invalid file format", 0);
-		}
-	}
+		if (n < 0)
+			return -1;
+		if (n == 0)
+			break;
 
-	/*
-	 * Step back, so certain position in the file will point to the start of
-	 * config line.
-	 */
-	if (fseek(file, -1, SEEK_CUR) != 0)
-		ereport_and_exit("Cannot fseek in file", 0);
+		total += n;
+	}
 
-	return 1;
+	return total;
 }
 
-static void
+/*
+ * Write the whole buffer, retrying after partial writes. Returns false on
+ * error.
+ */
+static bool
+write_block(int fd, const void *src, size_t size)
+{
+	size_t	done = 0;
+
+	while (done < size)
+	{
+		ssize_t n = write(fd, (const char *) src + done, size - done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return false;
+
+		done += n;
+	}
+
+	return true;
+}
+
+/*
+ * Put decimal representation of 'val' just before 'end'. Returns pointer to
+ * its first character. At least 21 characters before 'end' must be available.
+ */
+static char *
+format_decimal(char *end, long long val)
+{
+	unsigned long long abs_val = (val < 0) ? -(unsigned long long) val :
+		(unsigned long long) val;
+
+	do
+	{
+		*--end = '0' + abs_val % 10;
+		abs_val /= 10;
+	} while (abs_val != 0);
+
+	if (val < 0)
+		*--end = '-';
+
+	return end;
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_LZMA) || defined(HAVE_BZLIB) || \
+	defined(HAVE_ZSTD)
+/*
+ * Make more compressed input available in [in_pos, in_end). Returns false at
+ * the end of input.
+ */
+static bool
+reader_next_input(DimacsReader *reader)
+{
+	ssize_t		n;
+
+	if (reader->map != NULL ||
+		(n = read_block(reader->fd, reader->in_buf, READ_BLOCK_SIZE, 1)) <= 0)
+	{
+		reader->input_done = true;
+		return false;
+	}
+
+	reader->in_pos = reader->in_buf;
+	reader->in_end = reader->in_buf + n;
+
+	return true;
+}
+
+/*
+ * Decompressor has nothing more to produce, if it has not produced anything
+ * after all input is consumed.
+ */
+#define DecompressorIsDrained(reader, produced) \
+	((produced) == 0 && (reader)->in_pos == (reader)->in_end && \
+	 (reader)->input_done)
+#endif
+
+#ifdef HAVE_ZLIB
+/*
+ * Each of the decompressing functions below fills the block buffer and
+ * returns number of bytes put there: 0 at the end of input, -1 on error.
+ * Concatenated streams are decompressed one after another.
+ */
+static ssize_t
+decompress_gzip(DimacsReader *reader)
+{
+	z_stream   *zs = (z_stream *) reader->stream;
+	int			rc;
+
+	zs->next_out = (Bytef *) reader->buf;
+	zs->avail_out = READ_BLOCK_SIZE;
+
+	while (zs->avail_out > 0)
+	{
+		uInt	avail_out = zs->avail_out;
+
+		if (reader->in_pos == reader->in_end)
+			reader_next_input(reader);
+
+		zs->next_in = (Bytef *) reader->in_pos;
+		zs->avail_in = reader->in_end - reader->in_pos;
+		rc = inflate(zs, Z_NO_FLUSH);
+		reader->in_pos = zs->next_in;
+
+		if (rc == Z_STREAM_END)
+			rc = inflateReset(zs);
+		if (rc != Z_OK && rc != Z_BUF_ERROR)
+			return -1;
+		if (DecompressorIsDrained(reader, avail_out - zs->avail_out))
+			break;
+	}
+
+	return READ_BLOCK_SIZE - zs->avail_out;
+}
+#endif
+
+#ifdef HAVE_LZMA
+static ssize_t
+decompress_xz(DimacsReader *reader)
+{
+	lzma_stream *xs = (lzma_stream *) reader->stream;
+	lzma_ret	rc;
+
+	xs->next_out = (uint8_t *) reader->buf;
+	xs->avail_out = READ_BLOCK_SIZE;
+
+	while (xs->avail_out > 0)
+	{
+		if (reader->in_pos == reader->in_end)
+			reader_next_input(reader);
+
+		xs->next_in = reader->in_pos;
+		xs->avail_in = reader->in_end - reader->in_pos;
+		rc = lzma_code(xs, reader->input_done ? LZMA_FINISH : LZMA_RUN);
+		reader->in_pos = xs->next_in;
+
+		if (rc == LZMA_STREAM_END)
+		{
+			reader->finished = true;
+			break;
+		}
+		if (rc != LZMA_OK)
+			return -1;
+	}
+
+	return READ_BLOCK_SIZE - xs->avail_out;
+}
+#endif
+
+#ifdef HAVE_BZLIB
+static ssize_t
+decompress_bzip2(DimacsReader *reader)
+{
+	bz_stream  *bs = (bz_stream *) reader->stream;
+	int			rc;
+
+	bs->next_out = reader->buf;
+	bs->avail_out = READ_BLOCK_SIZE;
+
+	while (bs->avail_out > 0)
+	{
+		unsigned int avail_out = bs->avail_out;
+
+		if (reader->in_pos == reader->in_end)
+			reader_next_input(reader);
+
+		bs->next_in = (char *) reader->in_pos;
+		bs->avail_in = reader->in_end - reader->in_pos;
+		rc = BZ2_bzDecompress(bs);
+		reader->in_pos = (const unsigned char *) bs->next_in;
+
+		if (rc == BZ_STREAM_END)
+		{
+			BZ2_bzDecompressEnd(bs);
+			rc = BZ2_bzDecompressInit(bs, 0, 0);
+		}
+		if (rc != BZ_OK)
+			return -1;
+		if (DecompressorIsDrained(reader, avail_out - bs->avail_out))
+			break;
+	}
+
+	return READ_BLOCK_SIZE - bs->avail_out;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static ssize_t
+decompress_zstd(DimacsReader *reader)
+{
+	ZSTD_outBuffer out = {reader->buf, READ_BLOCK_SIZE, 0};
+
+	while (out.pos < out.size)
+	{
+		size_t			produced = out.pos;
+		ZSTD_inBuffer	in;
+
+		if (reader->in_pos == reader->in_end)
+			reader_next_input(reader);
+
+		in.src = reader->in_pos;
+		in.size = reader->in_end - reader->in_pos;
+		in.pos = 0;
+
+		if (ZSTD_isError(ZSTD_decompressStream((ZSTD_DStream *) reader->stream,
+											   &out, &in)))
+			return -1;
+
+		reader->in_pos += in.pos;
+		if (DecompressorIsDrained(reader, out.pos - produced))
+			break;
+	}
+
+	return out.pos;
+}
+#endif
+
+static int
+reader_refill(DimacsReader *reader)
+{
+	ssize_t		n = 0;
+
+	if (reader->finished)
+		return EOF;
+
+	switch (reader->compression)
+	{
+		case COMPRESSION_NONE:
+			if (reader->map != NULL)
+				return EOF;
+			n = read_block(reader->fd, reader->buf, READ_BLOCK_SIZE, 1);
+			break;
+#ifdef HAVE_ZLIB
+		case COMPRESSION_GZIP:
+			n = decompress_gzip(reader);
+			break;
+#endif
+#ifdef HAVE_LZMA
+		case COMPRESSION_XZ:
+			n = decompress_xz(reader);
+			break;
+#endif
+#ifdef HAVE_BZLIB
+		case COMPRESSION_BZIP2:
+			n = decompress_bzip2(reader);
+			break;
+#endif
+#ifdef HAVE_ZSTD
+		case COMPRESSION_ZSTD:
+			n = decompress_zstd(reader);
+			break;
+#endif
+		default:
+			break;
+	}
+
+	if (n < 0)
+	{
+		ereport("Cannot read from file");
+		exit(1);
+	}
+
+	if (n == 0)
+	{
+		reader->finished = true;
+		return EOF;
+	}
+
+	reader->pos = reader->buf;
+	reader->end = reader->buf + n;
+	reader->nbytes += n;
+
+	return (unsigned char) *reader->pos;
+}
+
+/* Current character of the input without consuming it, EOF at the end */
+#define ReaderPeek(reader) \
+	((reader)->pos < (reader)->end ? \
+	 (unsigned char) *(reader)->pos : reader_refill(reader))
+
+#define IsDimacsSpace(c) \
+	((c) == ' ' || (c) == '\n' || (c) == '\t' || (c) == '\r' || \
+	 (c) == '\v' || (c) == '\f')
+
+/* Enough bytes to recognize the cache and any of the compressed formats */
+#define MAX_MAGIC_SIZE		sizeof(CACHE_MAGIC)
+
+static Compression
+detect_compression(const unsigned char *data, size_t size)
+{
+	if (size >= 2 && data[0] == 0x1f && data[1] == 0x8b)
+		return COMPRESSION_GZIP;
+	if (size >= 6 && memcmp(data, "\xfd" "7zXZ\0", 6) == 0)
+		return COMPRESSION_XZ;
+	if (size >= 3 && memcmp(data, "BZh", 3) == 0)
+		return COMPRESSION_BZIP2;
+	if (size >= 4 && memcmp(data, "\x28\xb5\x2f\xfd", 4) == 0)
+		return COMPRESSION_ZSTD;
+
+	return COMPRESSION_NONE;
+}
+
+/*
+ * Set up the decompressor for the detected format. Returns false iff format
+ * is not supported by this build or decompressor cannot be initialized.
+ * Error is reported.
+ */
+static bool
+init_decompression(DimacsReader *reader)
+{
+	bool	ok = false;
+
+	switch (reader->compression)
+	{
+#ifdef HAVE_ZLIB
+		case COMPRESSION_GZIP:
+			if ((reader->stream = calloc(1, sizeof(z_stream))) != NULL &&
+				inflateInit2((z_stream *) reader->stream, 15 + 32) == Z_OK)
+				ok = true;
+			break;
+#endif
+#ifdef HAVE_LZMA
+		case COMPRESSION_XZ:
+			if ((reader->stream = calloc(1, sizeof(lzma_stream))) != NULL &&
+				lzma_stream_decoder((lzma_stream *) reader->stream, UINT64_MAX,
+									LZMA_CONCATENATED) == LZMA_OK)
+				ok = true;
+			break;
+#endif
+#ifdef HAVE_BZLIB
+		case COMPRESSION_BZIP2:
+			if ((reader->stream = calloc(1, sizeof(bz_stream))) != NULL &&
+				BZ2_bzDecompressInit((bz_stream *) reader->stream, 0, 0) == BZ_OK)
+				ok = true;
+			break;
+#endif
+#ifdef HAVE_ZSTD
+		case COMPRESSION_ZSTD:
+			if ((reader->stream = ZSTD_createDStream()) != NULL &&
+				!ZSTD_isError(ZSTD_initDStream((ZSTD_DStream *) reader->stream)))
+				ok = true;
+			break;
+#endif
+		default:
+			errno = 0;
+			ereport("Compressed input is not supported by this build");
+			return false;
+	}
+
+	if (!ok)
+		ereport("Cannot initialize decompression");
+
+	return ok;
+}
+
+static void
+end_decompression(DimacsReader *reader)
+{
+	if (reader->stream == NULL)
+		return;
+
+	switch (reader->compression)
+	{
+#ifdef HAVE_ZLIB
+		case COMPRESSION_GZIP:
+			inflateEnd((z_stream *) reader->stream);
+			break;
+#endif
+#ifdef HAVE_LZMA
+		case COMPRESSION_XZ:
+			lzma_end((lzma_stream *) reader->stream);
+			break;
+#endif
+#ifdef HAVE_BZLIB
+		case COMPRESSION_BZIP2:
+			BZ2_bzDecompressEnd((bz_stream *) reader->stream);
+			break;
+#endif
+#ifdef HAVE_ZSTD
+		case COMPRESSION_ZSTD:
+			ZSTD_freeDStream((ZSTD_DStream *) reader->stream);
+			reader->stream = NULL;
+			return;
+#endif
+		default:
+			break;
+	}
+
+	free(reader->stream);
+	reader->stream = NULL;
+}
+
+static void reader_close(DimacsReader *reader);
+
+/*
+ * Get a block buffer of READ_BLOCK_SIZE bytes for text or, if 'input' is
+ * true, for compressed input. Returns NULL iff memory cannot be allocated.
+ */
+static void *
+reader_block(DimacsReader *reader, bool input)
+{
+	void	  **reusable;
+
+	if (reader->buffers == NULL)
+		return malloc(READ_BLOCK_SIZE);
+
+	reusable = input ? &reader->buffers->in_block : &reader->buffers->block;
+	if (*reusable == NULL)
+		*reusable = malloc(READ_BLOCK_SIZE);
+
+	return *reusable;
+}
+
+/*
+ * Open the file at 'path', or the standard input if it is NULL or "-".
+ * 'buffers' are used instead of allocating new ones, if not NULL.
+ * Returns false iff file cannot be opened or mapped. Error is reported.
+ */
+static bool
+reader_open(DimacsReader *reader, const char *path, ReaderBuffers *buffers)
+{
+	struct stat st;
+	ssize_t		n;
+
+	memset(reader, 0, sizeof(DimacsReader));
+	reader->buffers = buffers;
+
+	if (path == NULL || strcmp(path, "-") == 0)
+		reader->fd = STDIN_FILENO;
+	else if ((reader->fd = open(path, O_RDONLY)) < 0)
+	{
+		ereport("Cannot open file");
+		return false;
+	}
+
+	if (fstat(reader->fd, &st) == 0 && S_ISREG(st.st_mode))
+	{
+		reader->is_regular = true;
+		reader->source = st;
+	}
+
+	if (reader->is_regular && st.st_size > 0)
+	{
+		reader->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+						   reader->fd, 0);
+		if (reader->map == MAP_FAILED)
+		{
+			/* Fall back to reading blocks */
+			reader->map = NULL;
+			errno = 0;
+		}
+	}
+
+	if (reader->map != NULL)
+	{
+		madvise(reader->map, st.st_size, MADV_SEQUENTIAL);
+		reader->map_size = st.st_size;
+		reader->pos = (const char *) reader->map;
+		reader->end = reader->pos + st.st_size;
+		reader->nbytes = st.st_size;
+		reader->compression =
+			detect_compression(reader->map, reader->map_size);
+	}
+	else
+	{
+		if ((reader->buf = (char *) reader_block(reader, false)) == NULL)
+		{
+			ereport("Cannot allocate memory for input buffer");
+			reader_close(reader);
+			return false;
+		}
+
+		/* The first block is read to look for magic bytes */
+		if ((n = read_block(reader->fd, reader->buf, READ_BLOCK_SIZE,
+							MAX_MAGIC_SIZE)) < 0)
+		{
+			ereport("Cannot read from file");
+			reader_close(reader);
+			return false;
+		}
+
+		reader->pos = reader->buf;
+		reader->end = reader->buf + n;
+		reader->nbytes = n;
+		reader->compression =
+			detect_compression((unsigned char *) reader->buf, n);
+	}
+
+	if (reader->compression == COMPRESSION_NONE)
+	{
+		reader->is_cache =
+			((size_t) (reader->end - reader->pos) >= sizeof(CACHE_MAGIC) &&
+			 memcmp(reader->pos, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0);
+		return true;
+	}
+
+	/* Data seen so far is compressed input rather than text */
+	if (reader->map != NULL)
+	{
+		reader->in_pos = (const unsigned char *) reader->map;
+		reader->in_end = reader->in_pos + reader->map_size;
+
+		if ((reader->buf = (char *) reader_block(reader, false)) == NULL)
+		{
+			ereport("Cannot allocate memory for input buffer");
+			reader_close(reader);
+			return false;
+		}
+	}
+	else
+	{
+		if ((reader->in_buf = (unsigned char *) reader_block(reader, true)) == NULL)
+		{
+			ereport("Cannot allocate memory for input buffer");
+			reader_close(reader);
+			return false;
+		}
+
+		memcpy(reader->in_buf, reader->buf, reader->end - reader->pos);
+		reader->in_pos = reader->in_buf;
+		reader->in_end = reader->in_buf + (reader->end - reader->pos);
+	}
+
+	reader->pos = reader->end = reader->buf;
+	reader->nbytes = 0;
+
+	if (!init_decompression(reader))
+	{
+		reader_close(reader);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+reader_close(DimacsReader *reader)
+{
+	end_decompression(reader);
+
+	if (reader->map != NULL)
+		munmap(reader->map, reader->map_size);
+
+	if (reader->buffers == NULL)
+	{
+		free(reader->buf);
+		free(reader->in_buf);
+	}
+
+	if (reader->fd != STDIN_FILENO)
+		close(reader->fd);
+}
+
+/*
+ * Skip the rest of the current line including its end.
+ */
+static void
+skip_line(DimacsReader *reader)
+{
+	int		c;
+
+	while ((c = ReaderPeek(reader)) != EOF)
+	{
+		reader->pos++;
+		if (c == '\n')
+			break;
+	}
+}
+
+/*
+ * Read next value from DIMACS-formatted file. Comment lines between values
+ * are skipped.
+ * Returns 0 on eof or on anything, that is not a number or does not fit into
+ * an int, 1 on success.
+ */
+static int
+read_next_val(DimacsReader *reader, int *val)
+{
+	int		c;
+	long long result = 0;
+	bool	negative = false;
+
+	while (true)
+	{
+		c = ReaderPeek(reader);
+
+		if (IsDimacsSpace(c))
+			reader->pos++;
+		else if (c == 'c')
+			skip_line(reader);
+		else
+			break;
+	}
+
+	if (c == '-')
+	{
+		negative = true;
+		reader->pos++;
+		c = ReaderPeek(reader);
+	}
+
+	if (c < '0' || c > '9')
+		return 0;
+
+	do
+	{
+		result = result * 10 + (c - '0');
+
+		/* Values must fit into an int, including its negation */
+		if (result > INT_MAX)
+			return 0;
+
+		reader->pos++;
+	} while ((c = ReaderPeek(reader)) >= '0' && c <= '9');
+
+	*val = (int) (negative ? -result : result);
+
+	return 1;
+}
+
+
+/*
+ * Read values of 'nclauses' clauses, each terminated by 0, into the growing
+ * array 'vals'. Input ends earlier, if it has less clauses.
+ *
+ * Returns false iff memory cannot be allocated.
+ */
+static bool
+read_clauses(DimacsReader *reader, int nclauses, int **vals, size_t *nvals)
+{
+	size_t	capacity = 1024;
+	int		clauses_read = 0;
+	int		val;
+
+	*nvals = 0;
+	if (reader->buffers != NULL && reader->buffers->vals != NULL)
+	{
+		*vals = reader->buffers->vals;
+		capacity = reader->buffers->vals_capacity;
+	}
+	else if ((*vals = (int *) malloc(sizeof(int) * capacity)) == NULL)
+		return false;
+
+	while (clauses_read < nclauses && read_next_val(reader, &val) == 1)
+	{
+		if (*nvals >= capacity)
+		{
+			int *grown;
+
+			capacity *= 2;
+			if ((grown = (int *) realloc(*vals, sizeof(int) * capacity)) == NULL)
+			{
+				free(*vals);
+				*vals = NULL;
+				capacity = 0;
+				break;
+			}
+			*vals = grown;
+		}
+
+		(*vals)[(*nvals)++] = val;
+		if (val == 0)
+			clauses_read++;
+	}
+
+	if (reader->buffers != NULL)
+	{
+		reader->buffers->vals = *vals;
+		reader->buffers->vals_capacity = capacity;
+	}
+
+	return *vals != NULL;
+}
+
+/*
+ * Free values returned by read_clauses and others, unless they are kept in
+ * buffers of the reader.
+ */
+static void
+reader_free_vals(DimacsReader *reader, int *vals)
+{
+	if (reader->buffers == NULL || vals != reader->buffers->vals)
+		free(vals);
+}
+
+/*
+ * Part of the mapped file parsed by a separate thread. Chunks start at the
+ * beginning of a line, so they never start in the middle of a number or a
+ * comment. Clause may span several chunks: values of all chunks, put one
+ * after another, are the same as if the file is read at once.
+ */
+typedef struct ParseChunk
+{
+	DimacsReader reader;
+	int			*vals;
+	size_t		nvals;
+	size_t		nclauses;	/* terminators among the values */
+	bool		ok;			/* memory is allocated */
+	bool		complete;	/* parsed to the end, not stopped by a non-number */
+	pthread_t	thread;
+}		ParseChunk;
+
+/* Smaller inputs are not worth starting threads for */
+#define PARSE_CHUNK_MIN_SIZE	(1 << 22)
+
+static void *
+parse_chunk(void *arg)
+{
+	ParseChunk *chunk = (ParseChunk *) arg;
+
+	chunk->ok = read_clauses(&chunk->reader, INT_MAX, &chunk->vals,
+							 &chunk->nvals);
+	if (!chunk->ok)
+		return NULL;
+
+	chunk->complete = (ReaderPeek(&chunk->reader) == EOF);
+	for (size_t i = 0; i < chunk->nvals; i++)
+		chunk->nclauses += (chunk->vals[i] == 0);
+
+	return NULL;
+}
+
+/*
+ * Same as read_clauses, but the rest of a mapped file is split into chunks
+ * parsed by several threads. Input, which is not mapped text, or is too small,
+ * is read by the calling thread.
+ */
+static bool
+read_clauses_parallel(DimacsReader *reader, int nclauses, int **vals,
+					  size_t *nvals)
+{
+	ParseChunk *chunks;
+	size_t		size = reader->end - reader->pos;
+	int			nthreads = reader->parse_threads;
+	int			nchunks = 0;
+	size_t		total = 0;
+	size_t		clauses_read = 0;
+	const char *stop = reader->end;
+	bool		ok = true;
+
+	if (nthreads <= 0)
+		nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if ((size_t) nthreads > size / PARSE_CHUNK_MIN_SIZE)
+		nthreads = (int) (size / PARSE_CHUNK_MIN_SIZE);
+
+	if (reader->map == NULL || reader->compression != COMPRESSION_NONE ||
+		nthreads <= 1 ||
+		(chunks = (ParseChunk *) calloc(nthreads, sizeof(ParseChunk))) == NULL)
+		return read_clauses(reader, nclauses, vals, nvals);
+
+	for (const char *start = reader->pos; start < reader->end; nchunks++)
+	{
+		const char *end = start + size / nthreads;
+
+		if (nchunks == nthreads - 1 || end >= reader->end)
+			end = reader->end;
+		else
+		{
+			end = memchr(end, '\n', reader->end - end);
+			end = (end == NULL) ? reader->end : end + 1;
+		}
+
+		chunks[nchunks].reader = *reader;
+		chunks[nchunks].reader.pos = start;
+		chunks[nchunks].reader.end = end;
+		chunks[nchunks].reader.buffers = NULL;	/* chunks are parsed at once */
+
+		if (pthread_create(&chunks[nchunks].thread, NULL, parse_chunk,
+						   &chunks[nchunks]) != 0)
+		{
+			/* Parse it here, if thread cannot be started */
+			parse_chunk(&chunks[nchunks]);
+			chunks[nchunks].thread = pthread_self();
+		}
+
+		start = end;
+	}
+
+	for (int i = 0; i < nchunks; i++)
+	{
+		if (!pthread_equal(chunks[i].thread, pthread_self()))
+			pthread_join(chunks[i].thread, NULL);
+		ok = ok && chunks[i].ok;
+		total += chunks[i].nvals;
+	}
+
+	if (ok && (*vals = (int *) malloc(sizeof(int) * (total + 1))) == NULL)
+		ok = false;
+
+	/*
+	 * Values go up to the 'nclauses'-th terminator, or up to the first
+	 * non-number, like in read_clauses.
+	 */
+	*nvals = 0;
+	for (int i = 0; ok && i < nchunks; i++)
+	{
+		size_t n = chunks[i].nvals;
+
+		if (clauses_read + chunks[i].nclauses >= (size_t) nclauses)
+		{
+			for (n = 0; clauses_read < (size_t) nclauses; n++)
+				clauses_read += (chunks[i].vals[n] == 0);
+		}
+		else
+			clauses_read += chunks[i].nclauses;
+
+		memcpy(*vals + *nvals, chunks[i].vals, sizeof(int) * n);
+		*nvals += n;
+
+		if (clauses_read >= (size_t) nclauses)
+			break;
+		if (!chunks[i].complete)
+		{
+			stop = chunks[i].reader.pos;
+			break;
+		}
+	}
+
+	for (int i = 0; i < nchunks; i++)
+		free(chunks[i].vals);
+	free(chunks);
+
+	/* Reader is left where parsing stopped, like after read_clauses */
+	reader->pos = stop;
+
+	return ok;
+}
+
+static uint64_t
+fnv1a_update(uint64_t hash, const uint32_t *words, size_t nwords)
+{
+	for (size_t i = 0; i < nwords; i++)
+		hash = (hash ^ words[i]) * FNV_PRIME;
+
+	return hash;
+}
+
+/*
+ * Append a varint to the buffer, which must have space for 10 bytes.
+ * Returns number of bytes written.
+ */
+static size_t
+encode_varint(unsigned char *dst, uint64_t val)
+{
+	size_t	n = 0;
+
+	while (val >= 0x80)
+	{
+		dst[n++] = (unsigned char) (val | 0x80);
+		val >>= 7;
+	}
+	dst[n++] = (unsigned char) val;
+
+	return n;
+}
+
+/*
+ * Words written to the cache are collected in a chunk and flushed to the
+ * file as it fills up. Checksum is computed over flushed words.
+ */
+typedef struct CacheWriter
+{
+	FILE		*file;
+	uint32_t	*chunk;
+	size_t		used;
+	uint64_t	checksum;
+	bool		ok;
+}		CacheWriter;
+
+#define CACHE_CHUNK_WORDS	(1 << 14)
+
+static void
+cache_flush(CacheWriter *writer)
+{
+	writer->checksum = fnv1a_update(writer->checksum, writer->chunk,
+									writer->used);
+
+	if (writer->ok &&
+		fwrite(writer->chunk, sizeof(uint32_t), writer->used,
+			   writer->file) != writer->used)
+		writer->ok = false;
+
+	writer->used = 0;
+}
+
+static void
+cache_put_word(CacheWriter *writer, uint32_t word)
+{
+	if (writer->used == CACHE_CHUNK_WORDS)
+		cache_flush(writer);
+
+	writer->chunk[writer->used++] = word;
+}
+
+/*
+ * Write the formula, which has just been built from the DIMACS file, to the
+ * cache at 'reader->cache_path'. The file is written under a temporary name
+ * and renamed, so a half-written cache is never seen.
+ *
+ * Returns false iff cache cannot be written. Error is reported.
+ */
+static bool
+write_cache(DimacsReader *reader, Formula *formula)
+{
+	CacheHeader header;
+	CacheWriter writer = {NULL, NULL, 0, FNV_OFFSET_BASIS, true};
+	char	   *tmp_path;
+	ClauseRef	ref = 0;
+
+	memset(&header, 0, sizeof(CacheHeader));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.byte_order = CACHE_BYTE_ORDER;
+	header.nvariables = formula->nvariables;
+	header.nclauses = formula->nclauses;
+	header.source_size = reader->source.st_size;
+	header.source_mtime_sec = reader->source.st_mtim.tv_sec;
+	header.source_mtime_nsec = reader->source.st_mtim.tv_nsec;
+	header.source_dev = reader->source.st_dev;
+	header.source_ino = reader->source.st_ino;
+
+	if ((tmp_path = (char *) malloc(strlen(reader->cache_path) + 5)) == NULL ||
+		(writer.chunk = (uint32_t *)
+			malloc(sizeof(uint32_t) * CACHE_CHUNK_WORDS)) == NULL)
+	{
+		free(tmp_path);
+		ereport("Cannot allocate memory for cache");
+		return false;
+	}
+
+	sprintf(tmp_path, "%s.tmp", reader->cache_path);
+
+	if ((writer.file = fopen(tmp_path, "wb")) == NULL)
+	{
+		ereport("Cannot create cache file");
+		free(tmp_path);
+		free(writer.chunk);
+		return false;
+	}
+
+	/* Header is written once more at the end, when checksum is known */
+	if (fwrite(&header, sizeof(CacheHeader), 1, writer.file) != 1)
+		writer.ok = false;
+
+	/*
+	 * Places of clauses after loading are kept in 'moved_to' meanwhile. The
+	 * arena of the formula may have gaps left by repeated literals.
+	 */
+	for (int i = 0; i < formula->nclauses; i++)
+	{
+		Clause	*c = ClauseAt(formula, formula->clauses[i]);
+
+		cache_put_word(&writer, c->n_literals);
+		header.nliterals += c->n_literals;
+
+		for (int j = 0; j < c->n_literals; j++)
+			cache_put_word(&writer, c->literals[j]);
+
+		c->moved_to = ref;
+		ref += ClauseWords(c->n_literals);
+	}
+
+	for (int i = 0; i < formula->nvariables; i++)
+	{
+		for (int k = 0; k < 2; k++)
+		{
+			WatchList *wl = &formula->variables[i].watches[k];
+
+			cache_put_word(&writer, wl->nclauses);
+			header.nwatches += wl->nclauses;
+
+			for (unsigned int j = 0; j < wl->nclauses; j++)
+				cache_put_word(&writer,
+							   ClauseAt(formula, wl->clauses[j])->moved_to);
+		}
+	}
+
+	for (int i = 0; i < formula->nclauses; i++)
+		ClauseAt(formula, formula->clauses[i])->n_true = 0;
+
+	cache_flush(&writer);
+	header.checksum = writer.checksum;
+
+	if (writer.ok &&
+		(fseek(writer.file, 0, SEEK_SET) != 0 ||
+		 fwrite(&header, sizeof(CacheHeader), 1, writer.file) != 1))
+		writer.ok = false;
+	if (fclose(writer.file) != 0)
+		writer.ok = false;
+	if (writer.ok && rename(tmp_path, reader->cache_path) != 0)
+		writer.ok = false;
+
+	if (!writer.ok)
+	{
+		ereport("Cannot write cache file");
+		unlink(tmp_path);
+	}
+
+	free(tmp_path);
+	free(writer.chunk);
+
+	return writer.ok;
+}
+
+/*
+ * Copy 'nwords' words of the cache into 'dst', updating the checksum. Each
+ * piece is hashed right after it is copied, while it is still in the
+ * processor cache. Returns false iff the cache ends earlier.
+ */
+static bool
+read_cache_words(DimacsReader *reader, uint32_t *dst, size_t nwords,
+				 uint64_t *checksum)
+{
+	size_t	size = sizeof(uint32_t) * nwords;
+	size_t	copied = 0;
+	size_t	hashed = 0;
+
+	while (copied < size)
+	{
+		size_t	n;
+
+		if (ReaderPeek(reader) == EOF)
+			return false;
+
+		n = reader->end - reader->pos;
+		if (n > size - copied)
+			n = size - copied;
+		if (n > sizeof(uint32_t) * CACHE_CHUNK_WORDS)
+			n = sizeof(uint32_t) * CACHE_CHUNK_WORDS;
+
+		memcpy((char *) dst + copied, reader->pos, n);
+		reader->pos += n;
+		copied += n;
+
+		/* Word split between blocks of input is hashed with the next piece */
+		*checksum = fnv1a_update(*checksum, dst + hashed,
+								 copied / sizeof(uint32_t) - hashed);
+		hashed = copied / sizeof(uint32_t);
+	}
+
+	return true;
+}
+
+/*
+ * Read header of the cache. Returns false iff it is not a cache made by
+ * this version of the solver on a host with the same byte order.
+ */
+static bool
+read_cache_header(DimacsReader *reader, CacheHeader *header)
+{
+	unsigned char *dst = (unsigned char *) header;
+
+	for (size_t i = 0; i < sizeof(CacheHeader); i++)
+	{
+		int c = ReaderPeek(reader);
+
+		if (c == EOF)
+			return false;
+
+		dst[i] = (unsigned char) c;
+		reader->pos++;
+	}
+
+	return memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+		header->version == CACHE_VERSION &&
+		header->byte_order == CACHE_BYTE_ORDER;
+}
+
+/* Words following the header of the cache */
+#define CachePayloadWords(header) \
+	((uint64_t) (header)->nclauses + (header)->nliterals + \
+	 2 * (uint64_t) (header)->nvariables + (header)->nwatches)
+
+/*
+ * Check whether the cache at 'path' is made from the file being read by
+ * 'reader' and the file has not changed since then. Only the header is read
+ * and the size of the cache is checked against it. The checksum is verified
+ * while the cache is loaded.
+ */
+static bool
+cache_is_fresh(const char *path, DimacsReader *reader)
+{
+	DimacsReader cache_reader;
+	CacheHeader header;
+	struct stat	st;
+	bool		fresh;
+	int			saved_errno = errno;
+
+	if (!reader->is_regular || stat(path, &st) != 0 ||
+		access(path, R_OK) != 0)
+	{
+		errno = saved_errno;
+		return false;
+	}
+
+	if (!reader_open(&cache_reader, path, NULL))
+		return false;
+
+	fresh = cache_reader.is_cache &&
+		read_cache_header(&cache_reader, &header) &&
+		header.nvariables >= 0 && header.nclauses >= 0 &&
+		(uint64_t) st.st_size ==
+			sizeof(CacheHeader) + sizeof(uint32_t) * CachePayloadWords(&header) &&
+		header.source_size == (uint64_t) reader->source.st_size &&
+		header.source_mtime_sec == reader->source.st_mtim.tv_sec &&
+		header.source_mtime_nsec == reader->source.st_mtim.tv_nsec &&
+		header.source_dev == (uint64_t) reader->source.st_dev &&
+		header.source_ino == (uint64_t) reader->source.st_ino;
+
+	reader_close(&cache_reader);
+
+	return fresh;
+}
+
+/*
+ * Find out how many clauses and variables the values of clauses actually
+ * have. The last clause may lack its terminator.
+ *
+ * Returns false iff the formula is too large to be loaded.
+ */
+static bool
+measure_clauses(int *vals, size_t nvals, int *nclauses, int *nvariables,
+				size_t *nliterals)
+{
+	size_t	clauses_found = 0;
+	int		max_var = 0;
+
+	*nliterals = 0;
+	for (size_t i = 0; i < nvals; i++)
+	{
+		if (vals[i] == 0)
+		{
+			clauses_found++;
+			continue;
+		}
+
+		if (abs(vals[i]) > max_var)
+			max_var = abs(vals[i]);
+		(*nliterals)++;
+	}
+
+	if (nvals > 0 && vals[nvals - 1] != 0)
+		clauses_found++;
+
+	/* Clauses are addressed by 32-bit offsets into the arena */
+	if (clauses_found > MAX_CLAUSES || max_var > MAX_VARIABLES ||
+		clauses_found * ClauseWords(0) + *nliterals >= InvalidClauseRef)
+		return false;
+
+	*nclauses = (int) clauses_found;
+	*nvariables = max_var;
+
+	return true;
+}
+
+/*
+ * Allocate arrays of the formula with 'nvariables' variables and 'nclauses'
+ * clauses having 'nliterals' literals in total. Clauses are not placed yet.
+ *
+ * Returns false iff memory cannot be allocated.
+ */
+static bool
+alloc_formula(Formula *formula, int nvariables, int nclauses,
+			  size_t nliterals)
+{
+	if ((formula->clauses = (ClauseRef *)
+			malloc(sizeof(ClauseRef) * ((size_t) nclauses + 1))) == NULL ||
+		(formula->variables = (Variable *)
+			malloc(sizeof(Variable) * ((size_t) nvariables + 1))) == NULL)
+		return false;
+
+	for (int i = 0; i < nvariables; i++)
+	{
+		Variable v = {
+			.assigned_value = VAL_UNASSIGNED,
+			.name = i + 1,
+			.nrelated_clauses = 0,
+			.related_clauses = NULL,
+			.watches = {{NULL, 0, 0}, {NULL, 0, 0}},
+			.level = 0,
+			.reason = InvalidClauseRef,
+			.seen = false,
+			.activity = 0.0,
+			.phase = VAL_UNASSIGNED,
+		};
+		formula->variables[i] = v;
+	}
+
+	formula->nvariables = nvariables;
+	formula->nliterals_total = nliterals;
+
+	/* Arena is sized to hold the formula, it grows only for learned clauses */
+	formula->arena.capacity = (size_t) nclauses * ClauseWords(0) + nliterals + 1;
+
+	return (formula->arena.data = (unsigned int *)
+				malloc(sizeof(unsigned int) * formula->arena.capacity)) != NULL &&
+		(formula->learnt_buf = (Literal *)
+			malloc(sizeof(Literal) * ((size_t) nvariables + 1))) != NULL &&
+		(formula->level_marks = (unsigned int *)
+			calloc((size_t) nvariables + 1, sizeof(unsigned int))) != NULL;
+}
+
+/*
+ * Allocate the watch list with its capacity, which is already set to the
+ * number of clauses watching the literal. Returns false iff memory cannot be
+ * allocated.
+ */
+static bool
+alloc_watch_list(WatchList *wl)
+{
+	if (wl->capacity > 0 &&
+		(wl->clauses = (ClauseRef *)
+			malloc(sizeof(ClauseRef) * wl->capacity)) == NULL)
+	{
+		wl->capacity = 0;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Load the formula from the cache, which header is already read. Checksum is
+ * verified while words are copied. Literals and references to clauses are
+ * checked as they are placed, so a damaged cache is rejected rather than
+ * trusted.
+ *
+ * Returns NULL iff cache is damaged or memory cannot be allocated. Error is
+ * reported.
+ */
+static Formula *
+load_cached_formula(DimacsReader *reader)
+{
+	CacheHeader *header = &reader->cache;
+	Formula    *formula;
+	uint32_t   *words = NULL;
+	unsigned char *watchable = NULL;	/* bit per arena word */
+	uint64_t	checksum = FNV_OFFSET_BASIS;
+	size_t		nwords;
+	size_t		pos = 0;
+
+	if (header->nvariables < 0 || header->nvariables > MAX_VARIABLES ||
+		header->nclauses < 0 || header->nclauses > MAX_CLAUSES ||
+		(uint64_t) header->nclauses * ClauseWords(0) + header->nliterals >=
+			InvalidClauseRef)
+	{
+		errno = 0;
+		ereport("Cache file is corrupted");
+		return NULL;
+	}
+
+	nwords = CachePayloadWords(header);
+
+	if ((formula = (Formula *) calloc(1, sizeof(Formula))) == NULL ||
+		(words = (uint32_t *) malloc(sizeof(uint32_t) * (nwords + 1))) == NULL ||
+		!alloc_formula(formula, header->nvariables, header->nclauses,
+					   header->nliterals) ||
+		(watchable = (unsigned char *)
+			calloc(formula->arena.capacity / 8 + 1, 1)) == NULL)
+	{
+		free(words);
+		drop_formula(formula);
+		ereport("Cannot allocate memory for formula");
+		return NULL;
+	}
+
+	if (!read_cache_words(reader, words, nwords, &checksum) ||
+		checksum != header->checksum || ReaderPeek(reader) != EOF)
+		goto corrupted;
+
+	for (int i = 0; i < header->nclauses; i++)
+	{
+		uint32_t	n = words[pos++];
+		ClauseRef	ref;
+		Clause	   *c;
+
+		if (n > nwords - pos)
+			goto corrupted;
+
+		ref = alloc_clause(formula, n);
+		c = ClauseAt(formula, ref);
+		formula->clauses[i] = ref;
+		formula->nclauses++;
+
+		/* Only clauses with literals may be referred to by watch lists */
+		if (n > 0)
+			watchable[ref / 8] |= 1 << (ref % 8);
+
+		for (uint32_t j = 0; j < n; j++)
+		{
+			if (words[pos] >= 2 * (uint32_t) formula->nvariables)
+				goto corrupted;
+			c->literals[j] = words[pos++];
+		}
+	}
+
+	for (int i = 0; i < formula->nvariables; i++)
+	{
+		for (int k = 0; k < 2; k++)
+		{
+			WatchList *wl = &formula->variables[i].watches[k];
+
+			if (pos == nwords || words[pos] > nwords - pos - 1)
+				goto corrupted;
+
+			wl->capacity = words[pos++];
+			if (!alloc_watch_list(wl))
+			{
+				free(words);
+				free(watchable);
+				drop_formula(formula);
+				ereport("Cannot allocate memory for watches");
+				return NULL;
+			}
+
+			for (unsigned int j = 0; j < wl->capacity; j++)
+			{
+				ClauseRef ref = words[pos++];
+
+				if (ref >= formula->arena.size ||
+					(watchable[ref / 8] & (1 << (ref % 8))) == 0)
+					goto corrupted;
+				wl->clauses[wl->nclauses++] = ref;
+			}
+		}
+	}
+
+	if (pos != nwords)
+		goto corrupted;
+
+	free(words);
+	free(watchable);
+
+	return formula;
+
+corrupted:
+	free(words);
+	free(watchable);
+	drop_formula(formula);
+	errno = 0;
+	ereport("Cache file is corrupted");
+	return NULL;
+}
+
+/*
+ * Build the formula from clauses that follow the problem line. Numbers of
+ * clauses and variables from the problem line are only expected: if the
+ * input disagrees with them, a warning is emitted and the formula is built
+ * from what the input actually contains.
+ */
+static Formula *
+create_formula(DimacsReader *reader, int nclauses, int nvariables)
+{
+	Formula *formula;
+	int		*vals;
+	size_t	nvals;
+	size_t	next_val = 0;
+	size_t	nliterals;
+	int		nclauses_found;
+	int		nvariables_found;
+	signed char *marks;
+	bool	*watched = NULL;
+
+	/* Cache holds the formula ready to be placed */
+	if (reader->is_cache)
+		return load_cached_formula(reader);
+
+	if ((formula = (Formula *) calloc(1, sizeof(Formula))) == NULL)
+		ereport_and_exit("Cannot allocate memory for Formula", NULL);
+
+	/*
+	 * Values are buffered first, so sizes of clauses are known before
+	 * literals are placed. Text is read up to its end, even if it has more
+	 * clauses than declared.
+	 */
+	if (!read_clauses_parallel(reader, INT_MAX, &vals, &nvals))
+	{
+		drop_formula(formula);
+		ereport_and_exit("Cannot allocate memory for clauses", NULL);
+	}
+	else if (ReaderPeek(reader) >= '0' && ReaderPeek(reader) <= '9')
+	{
+		/* Parsing stopped in the middle of a number */
+		reader_free_vals(reader, vals);
+		drop_formula(formula);
+		errno = 0;
+		ereport_and_exit("Literal is out of range", NULL);
+	}
+
+	if (!measure_clauses(vals, nvals, &nclauses_found, &nvariables_found,
+						 &nliterals))
+	{
+		reader_free_vals(reader, vals);
+		drop_formula(formula);
+		errno = 0;
+		ereport_and_exit("Formula is too large", NULL);
+	}
+
+	if (nclauses_found != nclauses)
+		fprintf(stderr, "Warning: problem line declares %d clauses, "
+				"but %d are found\n", nclauses, nclauses_found);
+	nclauses = nclauses_found;
+
+	/*
+	 * Variables are allocated up to the largest one used, so a problem line
+	 * declaring many more variables costs nothing. Model lists only them.
+	 */
+	if (nvariables_found > nvariables)
+		fprintf(stderr, "Warning: problem line declares %d variables, "
+				"but variable %d is used\n", nvariables, nvariables_found);
+	else if (nvariables_found < nvariables)
+		fprintf(stderr, "Warning: problem line declares %d variables, "
+				"but none above %d is used\n", nvariables, nvariables_found);
+	nvariables = nvariables_found;
+
+	if (!alloc_formula(formula, nvariables, nclauses, nliterals))
+	{
+		reader_free_vals(reader, vals);
+		drop_formula(formula);
+		ereport_and_exit("Cannot allocate memory for formula", NULL);
+	}
+
+	for (int i = 0; i < nclauses; i++)
+	{
+		size_t		end = next_val;
+		ClauseRef	ref;
+		Clause		*c;
+
+		while (end < nvals && vals[end] != 0)
+			end++;
+
+		ref = alloc_clause(formula, end - next_val);
+		c = ClauseAt(formula, ref);
+		formula->clauses[i] = ref;
+		formula->nclauses++;
+
+		for (size_t j = next_val; j < end; j++)
+			c->literals[j - next_val] = MakeLiteral(abs(vals[j]) - 1,
+													vals[j] < 0);
+
+		next_val = (end < nvals) ? end + 1 : end;
+	}
+
+	reader_free_vals(reader, vals);
+
+	if ((marks = (signed char *) calloc((size_t) nvariables + 1,
+										sizeof(signed char))) == NULL ||
+		(watched = (bool *) malloc(sizeof(bool) * ((size_t) nclauses + 1))) == NULL)
+	{
+		free(marks);
+		drop_formula(formula);
+		ereport_and_exit("Cannot allocate memory for watches", NULL);
+	}
+
+	/*
+	 * Clauses watching each literal are counted first, so that watch lists
+	 * are allocated once with their final size instead of growing clause by
+	 * clause.
+	 */
+	for (int i = 0; i < nclauses; i++)
+	{
+		Clause *c = ClauseAt(formula, formula->clauses[i]);
+
+		if (!(watched[i] = normalize_clause(formula, formula->clauses[i],
+											marks)))
+			continue;
+
+		LiteralWatchList(formula, c->literals[0])->capacity++;
+		if (c->n_literals > 1)
+			LiteralWatchList(formula, c->literals[1])->capacity++;
+	}
+
+	free(marks);
+
+	for (int i = 0; i < nvariables; i++)
+	{
+		if (!alloc_watch_list(&formula->variables[i].watches[0]) ||
+			!alloc_watch_list(&formula->variables[i].watches[1]))
+		{
+			free(watched);
+			drop_formula(formula);
+			ereport_and_exit("Cannot allocate memory for watches", NULL);
+		}
+	}
+
+	for (int i = 0; i < nclauses; i++)
+	{
+		if (watched[i])
+			attach_clause(formula, formula->clauses[i]);
+	}
+
+	free(watched);
+
+	/* Solving goes on without the cache, if it cannot be written */
+	if (reader->cache_path != NULL)
+		write_cache(reader, formula);
+
+	return formula;
+}
+
+/*
+ * Make a copy of the formula, which has not been solved yet, to be solved
+ * independently. Clauses are copied, since the search reorders their
+ * literals, but the list of clauses is shared.
+ *
+ * Returns NULL iff memory cannot be allocated.
+ */
+static Formula *
+clone_formula(const Formula *src)
+{
+	Formula *formula;
+
+	if ((formula = (Formula *) calloc(1, sizeof(Formula))) == NULL)
+		return NULL;
+
+	formula->parent = src;
+	formula->clauses = src->clauses;
+	formula->nclauses = src->nclauses;
+	formula->nvariables = src->nvariables;
+	formula->nliterals_total = src->nliterals_total;
+
+	formula->arena.size = src->arena.size;
+	formula->arena.capacity = src->arena.size;
+	if ((formula->arena.data = (unsigned int *)
+			malloc(sizeof(unsigned int) * (src->arena.size + 1))) == NULL ||
+		(formula->variables = (Variable *)
+			calloc((size_t) src->nvariables + 1, sizeof(Variable))) == NULL ||
+		(formula->learnt_buf = (Literal *)
+			malloc(sizeof(Literal) * ((size_t) src->nvariables + 1))) == NULL ||
+		(formula->level_marks = (unsigned int *)
+			calloc((size_t) src->nvariables + 1, sizeof(unsigned int))) == NULL)
+	{
+		drop_formula(formula);
+		return NULL;
+	}
+
+	memcpy(formula->arena.data, src->arena.data,
+		   sizeof(unsigned int) * src->arena.size);
+	memcpy(formula->variables, src->variables,
+		   sizeof(Variable) * src->nvariables);
+
+	/* Watch lists are own, related clauses are collected when needed */
+	for (int i = 0; i < formula->nvariables; i++)
+	{
+		formula->variables[i].nrelated_clauses = 0;
+		formula->variables[i].related_clauses = NULL;
+
+		for (int k = 0; k < 2; k++)
+		{
+			formula->variables[i].watches[k].clauses = NULL;
+			formula->variables[i].watches[k].capacity = 0;
+		}
+	}
+
+	for (int i = 0; i < formula->nvariables; i++)
+	{
+		for (int k = 0; k < 2; k++)
+		{
+			const WatchList *src_wl = &src->variables[i].watches[k];
+			WatchList  *wl = &formula->variables[i].watches[k];
+
+			if (src_wl->nclauses == 0)
+				continue;
+
+			if ((wl->clauses = (ClauseRef *)
+					malloc(sizeof(ClauseRef) * src_wl->nclauses)) == NULL)
+			{
+				drop_formula(formula);
+				return NULL;
+			}
+
+			memcpy(wl->clauses, src_wl->clauses,
+				   sizeof(ClauseRef) * src_wl->nclauses);
+			wl->capacity = src_wl->nclauses;
+		}
+	}
+
+	return formula;
+}
+
+typedef enum AssignmentType
+{
+	VAL_PROPAGATION = 1,
+	UNIT_PROPAGATION = 2,
+	FLIP_PROPAGATION = 3, /* second branch of a decision in DPLL mode */
+	PATH_PROPAGATION = 4, /* literal of a cube or guiding path, never flipped */
+}		AssignmentType;
+
+/*
+ * Entry of the assignment stack. Variables are always assigned from
+ * VAL_UNASSIGNED, so the old value is not stored, and both the value and the
+ * type fit into a byte each.
+ */
+typedef struct Assignment
+{
+	unsigned int	literal_name;
+	unsigned char	newval;	/* VAL_FALSE or VAL_TRUE */
+	unsigned char	type;	/* AssignmentType */
+}		Assignment;
+
+/*
+ * Stack of all current assignments in order they were made (trail). It also
+ * serves as a propagation queue: assignments below 'qhead' have already been
+ * propagated through the watch lists, others are waiting for it.
+ *
+ * Each variable is on the stack at most once, so it is allocated with an
+ * entry per variable and never overflows.
+ */
+typedef struct AssignmentStack
+{
+	Assignment		*data;
+	unsigned int	depth;
+	unsigned int	qhead;
+
+	/*
+	 * Each decision starts a new level. level_start[i] is the depth at which
+	 * decision of level (i + 1) is placed. Level 0 holds assignments implied
+	 * by the formula itself.
+	 */
+	unsigned int	*level_start;
+	unsigned int	nlevels;
+}		AssignmentStack;
+
+static void
+push(AssignmentStack *stack, Assignment *s)
+{
+	stack->data[stack->depth++] = *s;
+}
+
+static unsigned int
+decision_level(AssignmentStack *stack)
+{
+	return stack->nlevels;
+}
+
+static void
+new_decision_level(AssignmentStack *stack)
+{
+	stack->level_start[stack->nlevels++] = stack->depth;
+}
+
+/*
+ * Files in DIMACS format may contain comments - lines beginning with 'c'
+ * literal. This function will skip them and read the problem line
+ * "p cnf <variables> <clauses>". For cache files their header is read.
+ *
+ * Function returns non-zero value iff problem line is read successfully.
+ */
+static int
+read_header(DimacsReader *reader, int *nvariables, int *nclauses)
+{
+	int		c;
+
+	if (reader->is_cache)
+	{
+		if (!read_cache_header(reader, &reader->cache))
+			ereport_and_exit("Cache file is damaged or made by another version of the solver", 0);
+
+		*nvariables = reader->cache.nvariables;
+		*nclauses = reader->cache.nclauses;
+		return 1;
+	}
+
+	while ((c = ReaderPeek(reader)) != 'p')
+	{
+		if (c == EOF)
+			ereport_and_exit("Cannot read from file", 0);
+
+		/*
+		 * We are expecting only 'c' or 'p' literal at the beginning of the
+		 * line. Empty lines are tolerated.
+		 */
+		if (c != 'c' && !IsDimacsSpace(c))
+			ereport_and_exit("Invalid file format", 0);
+
+		skip_line(reader);
+	}
+
+	reader->pos++;
+	while ((c = ReaderPeek(reader)) == ' ' || c == '\t')
+		reader->pos++;
+
+	for (const char *expected = "cnf"; *expected != '\0'; expected++)
+	{
+		if (ReaderPeek(reader) != *expected)
+			ereport_and_exit("Cannot read configuration from file - wrong format", 0);
+		reader->pos++;
+	}
+
+	if (!read_next_val(reader, nvariables) || !read_next_val(reader, nclauses) ||
+		*nvariables < 0 || *nclauses < 0)
+		ereport_and_exit("Cannot read configuration from file - wrong format", 0);
+
+	if (*nvariables > MAX_VARIABLES || *nclauses > MAX_CLAUSES)
+		ereport_and_exit("Too many variables or clauses", 0);
+
+	return 1;
+}
+
+#define HeapActivity(formula, pos) \
+	((formula)->variables[(formula)->order.data[(pos)]].activity)
+
+static void
+heap_place(Formula *formula, unsigned int pos, unsigned int var_idx)
+{
+	formula->order.data[pos] = var_idx;
+	formula->order.position[var_idx] = pos;
+}
+
+static void
+heap_sift_up(Formula *formula, unsigned int pos)
+{
+	unsigned int var_idx = formula->order.data[pos];
+	double		activity = formula->variables[var_idx].activity;
+
+	while (pos > 0 && HeapActivity(formula, (pos - 1) / 2) < activity)
+	{
+		heap_place(formula, pos, formula->order.data[(pos - 1) / 2]);
+		pos = (pos - 1) / 2;
+	}
+
+	heap_place(formula, pos, var_idx);
+}
+
+static void
+heap_sift_down(Formula *formula, unsigned int pos)
+{
+	VariableHeap *heap = &formula->order;
+	unsigned int var_idx = heap->data[pos];
+	double		activity = formula->variables[var_idx].activity;
+
+	while (2 * pos + 1 < heap->size)
+	{
+		unsigned int child = 2 * pos + 1;
+
+		if (child + 1 < heap->size &&
+			HeapActivity(formula, child + 1) > HeapActivity(formula, child))
+			child++;
+
+		if (HeapActivity(formula, child) <= activity)
+			break;
+
+		heap_place(formula, pos, heap->data[child]);
+		pos = child;
+	}
+
+	heap_place(formula, pos, var_idx);
+}
+
+static void
+heap_insert(Formula *formula, unsigned int var_idx)
+{
+	if (formula->order.position[var_idx] >= 0)
+		return;
+
+	heap_place(formula, formula->order.size++, var_idx);
+	heap_sift_up(formula, formula->order.size - 1);
+}
+
+static unsigned int
+heap_pop(Formula *formula)
+{
+	VariableHeap *heap = &formula->order;
+	unsigned int top = heap->data[0];
+
+	heap->position[top] = -1;
+	if (--heap->size > 0)
+	{
+		heap_place(formula, 0, heap->data[heap->size]);
+		heap_sift_down(formula, 0);
+	}
+
+	return top;
+}
+
+#define HeuristicUsesCounts(heuristic) \
+	((heuristic) == HEURISTIC_DLIS || (heuristic) == HEURISTIC_MOMS || \
+	 (heuristic) == HEURISTIC_JW)
+
+/*
+ * Add 'sign' to the counts of all literals of the clause. 'short_size' is the
+ * size of clauses counted for MOMS.
+ */
+static void
+count_clause_literals(Formula *formula, Clause *c, int sign, int short_size)
+{
+	/*
+	 * Clause sizes here are the original ones, not the number of unassigned
+	 * literals: the clause is weighted and counted as short by its size in
+	 * the input. This departs from textbook MOMS and Jeroslow-Wang, which
+	 * look at the clause shrunk by the current assignment, but keeps the
+	 * counts cheap to maintain.
+	 */
+	double	weight = sign * ldexp(1.0, -c->n_literals);
+
+	if (formula->unsatisfied_by_size != NULL)
+		formula->unsatisfied_by_size[c->n_literals] += sign;
+
+	for (int i = 0; i < c->n_literals; i++)
+	{
+		LiteralFrequency *lf =
+			&formula->lfrequency[LiteralFrequencyIndex(c->literals[i])];
+
+		lf->freq += sign;
+		lf->weight += weight;
+		if (c->n_literals == short_size)
+			lf->short_freq += sign;
+	}
+}
+
+/*
+ * Make 'short_freq' count clauses of the minimum size among those, that are
+ * not satisfied yet. Counts are made anew, when all clauses of the current
+ * size become satisfied, or backtracking brings back shorter ones.
+ */
+static void
+follow_short_clause_size(Formula *formula)
+{
+	int		size = 2;
+
+	while (size <= formula->max_clause_size &&
+		   formula->unsatisfied_by_size[size] == 0)
+		size++;
+
+	/* All clauses are satisfied, there is nothing to count */
+	if (size > formula->max_clause_size ||
+		size == formula->short_clause_size)
+		return;
+
+	for (int i = 0; i < 2 * formula->nvariables; i++)
+		formula->lfrequency[i].short_freq = 0;
+
+	for (int i = 0; i < formula->nclauses; i++)
+	{
+		Clause *c = ClauseAt(formula, formula->clauses[i]);
+
+		if (c->n_literals != size || c->n_true != 0)
+			continue;
+
+		for (int j = 0; j < c->n_literals; j++)
+			formula->lfrequency[LiteralFrequencyIndex(c->literals[j])]
+				.short_freq++;
+	}
+
+	formula->short_clause_size = size;
+}
+
+/*
+ * Maintain dynamic literal counts: clause stops being counted when its first
+ * literal becomes true and is counted again when the last true literal is
+ * reverted. Must be called after variable is assigned with sign 1 and before
+ * its value is forgotten with sign -1.
+ */
+static void
+update_literal_counts(Formula *formula, Variable *v, int sign)
+{
+	if (!HeuristicUsesCounts(formula->heuristic) || formula->static_counts)
+		return;
+
+	for (unsigned int i = 0; i < v->nrelated_clauses; i++)
+	{
+		Clause	*c = ClauseAt(formula, v->related_clauses[i]);
+		int		old_true = c->n_true;
+
+		for (int j = 0; j < c->n_literals; j++)
+		{
+			if (LiteralVarIdx(c->literals[j]) == v->name - 1 &&
+				LiteralGivesTrue(formula, c->literals[j]))
+				c->n_true += sign;
+		}
+
+		if ((old_true == 0) != (c->n_true == 0))
+			count_clause_literals(formula, c, -sign,
+								  formula->short_clause_size);
+	}
+}
+
+/*
+ * Score of the variable for literal count heuristics. 'value' is set to the
+ * polarity, which satisfies more clauses.
+ */
+static double
+literal_count_score(Formula *formula, unsigned int var_idx,
+					AssignedValue *value)
+{
+	LiteralFrequency *pos = &formula->lfrequency[2 * var_idx];
+	LiteralFrequency *neg = &formula->lfrequency[2 * var_idx + 1];
+
+	switch (formula->heuristic)
+	{
+		case HEURISTIC_DLIS:
+			*value = (pos->freq >= neg->freq) ? VAL_TRUE : VAL_FALSE;
+			return (pos->freq >= neg->freq) ? pos->freq : neg->freq;
+		case HEURISTIC_MOMS:
+			*value = (pos->short_freq >= neg->short_freq) ? VAL_TRUE : VAL_FALSE;
+			return (pos->short_freq + neg->short_freq) * MOMS_FACTOR +
+				(double) pos->short_freq * neg->short_freq;
+		default:
+			*value = (pos->weight >= neg->weight) ? VAL_TRUE : VAL_FALSE;
+			return pos->weight + neg->weight;
+	}
+}
+
+/*
+ * Prepare the decision heuristic. Returns false iff memory cannot be
+ * allocated.
+ */
+static bool
+init_decision_heuristic(Formula *formula, DecisionHeuristic heuristic,
+						bool static_counts)
+{
+	formula->heuristic = heuristic;
+	formula->static_counts = static_counts;
+	formula->activity_inc = 1.0;
+
+	if (HeuristicUsesCounts(heuristic))
+	{
+		int		short_size = INT_MAX;
+		int		max_size = 0;
+
+		if ((formula->lfrequency = (LiteralFrequency *)
+				calloc(2 * formula->nvariables, sizeof(LiteralFrequency))) == NULL)
+			return false;
+
+		/* Single-literal clauses are propagated before any decision */
+		for (int i = 0; i < formula->nclauses; i++)
+		{
+			int n = ClauseAt(formula, formula->clauses[i])->n_literals;
+
+			if (n > 1 && n < short_size)
+				short_size = n;
+			if (n > max_size)
+				max_size = n;
+		}
+
+		formula->short_clause_size = short_size;
+		formula->max_clause_size = max_size;
+
+		if (!static_counts && !collect_related_clauses(formula))
+			return false;
+
+		/* Static MOMS keeps counting clauses of the initial minimum size */
+		if (heuristic == HEURISTIC_MOMS && !static_counts &&
+			(formula->unsatisfied_by_size = (int *)
+				calloc((size_t) max_size + 1, sizeof(int))) == NULL)
+			return false;
+
+		for (int i = 0; i < formula->nclauses; i++)
+			count_clause_literals(formula,
+								  ClauseAt(formula, formula->clauses[i]),
+								  1, short_size);
+	}
+
+	/* Dynamic counts change too often, so variables are scanned linearly */
+	if (heuristic == HEURISTIC_FIRST ||
+		(HeuristicUsesCounts(heuristic) && !static_counts))
+		return true;
+
+	formula->order.data = (unsigned int *)
+		malloc(sizeof(unsigned int) * formula->nvariables);
+	formula->order.position = (int *)
+		malloc(sizeof(int) * formula->nvariables);
+
+	if (formula->order.data == NULL || formula->order.position == NULL)
+		return false;
+
+	/* Static scores never change, so they are used as activities */
+	if (heuristic != HEURISTIC_VSIDS)
+	{
+		AssignedValue value;
+
+		for (int i = 0; i < formula->nvariables; i++)
+			formula->variables[i].activity =
+				literal_count_score(formula, i, &value);
+	}
+
+	formula->order.size = 0;
+	for (int i = 0; i < formula->nvariables; i++)
+	{
+		formula->order.position[i] = -1;
+		heap_insert(formula, i);
+	}
+
+	return true;
+}
+
+static unsigned long long
+next_random(Formula *formula)
+{
+	formula->random_state ^= formula->random_state >> 12;
+	formula->random_state ^= formula->random_state << 25;
+	formula->random_state ^= formula->random_state >> 27;
+
+	return formula->random_state * 2685821657736338717ULL;
+}
+
+/*
+ * Set initial phases of all variables. Returns false iff memory cannot be
+ * allocated.
+ */
+static bool
+init_phases(Formula *formula, PhasePolicy policy, bool phase_saving,
+			unsigned long long seed)
+{
+	int		*balance = NULL;
+
+	formula->phase_saving = phase_saving;
+	formula->random_state = (seed != 0) ? seed : 1;
+
+	if (policy == PHASE_OCCURRENCE)
+	{
+		/* Positive occurrences minus negative ones for each variable */
+		if ((balance = (int *) calloc(formula->nvariables, sizeof(int))) == NULL)
+			return false;
+
+		for (int i = 0; i < formula->nclauses; i++)
+		{
+			Clause *c = ClauseAt(formula, formula->clauses[i]);
+
+			for (int j = 0; j < c->n_literals; j++)
+				balance[LiteralVarIdx(c->literals[j])] +=
+					LiteralIsNegated(c->literals[j]) ? -1 : 1;
+		}
+	}
+
+	for (int i = 0; i < formula->nvariables; i++)
+	{
+		AssignedValue *phase = &formula->variables[i].phase;
+
+		switch (policy)
+		{
+			case PHASE_DEFAULT:
+				*phase = VAL_UNASSIGNED;
+				break;
+			case PHASE_TRUE:
+				*phase = VAL_TRUE;
+				break;
+			case PHASE_FALSE:
+				*phase = VAL_FALSE;
+				break;
+			case PHASE_RANDOM:
+				*phase = (next_random(formula) >> 32) & 1;
+				break;
+			case PHASE_OCCURRENCE:
+				*phase = (balance[i] >= 0) ? VAL_TRUE : VAL_FALSE;
+				break;
+		}
+	}
+
+	free(balance);
+	return true;
+}
+
+static void
+bump_variable_activity(Formula *formula, Variable *v)
+{
+	unsigned int var_idx = v->name - 1;
+
+	if (formula->heuristic != HEURISTIC_VSIDS)
+		return;
+
+	if ((v->activity += formula->activity_inc) > VSIDS_RESCALE_LIMIT)
+	{
+		for (int i = 0; i < formula->nvariables; i++)
+			formula->variables[i].activity /= VSIDS_RESCALE_LIMIT;
+		formula->activity_inc /= VSIDS_RESCALE_LIMIT;
+	}
+
+	if (formula->order.position[var_idx] >= 0)
+		heap_sift_up(formula, formula->order.position[var_idx]);
+}
+
+/*
+ * Instead of decaying all activities, make all further bumps more valuable
+ * (exponential VSIDS).
+ */
+static void
+decay_variable_activities(Formula *formula)
+{
+	formula->activity_inc /= VSIDS_DECAY;
+}
+
+/*
+ * Watched literals don't have to be moved on backtracking, so it is enough to
+ * forget value of the variable.
+ */
+static void
 revert_change(Formula *formula, Assignment a)
 {
-	Variable *v = &formula->variables[a.literal_name - 1];
+	Variable *v = &formula->variables[a.literal_name - 1];
+
+	update_literal_counts(formula, v, -1);
+
+	if (formula->phase_saving)
+		v->phase = v->assigned_value;
+	v->assigned_value = VAL_UNASSIGNED;
+
+	if (formula->order.data != NULL)
+		heap_insert(formula, a.literal_name - 1);
+}
+
+/*
+ * Revert all assignments made above the given decision level. Only variables
+ * on the stack are touched, clauses stay as they are.
+ */
+static void
+backtrack(Formula *formula, AssignmentStack *stack, unsigned int level)
+{
+	unsigned int target_depth;
+
+	if (decision_level(stack) <= level)
+		return;
+
+	target_depth = stack->level_start[level];
+
+	while (stack->depth > target_depth)
+		revert_change(formula, stack->data[--stack->depth]);
+
+	if (stack->qhead > stack->depth)
+		stack->qhead = stack->depth;
+
+	stack->nlevels = level;
+}
+
+/*
+ * Assign value to the variable and put it to the stack. Assignment will be
+ * propagated when unit_propagate reaches it. 'reason' is the clause implying
+ * the value, InvalidClauseRef for decisions.
+ */
+static void
+enqueue_assignment(Formula *formula, AssignmentStack *stack, Assignment *a,
+				   ClauseRef reason)
+{
+	Variable *v = &formula->variables[a->literal_name - 1];
+
+	v->assigned_value = a->newval;
+	v->level = decision_level(stack);
+	v->reason = reason;
+	update_literal_counts(formula, v, 1);
+	push(stack, a);
+}
+
+static ClauseRef propagate_literal_value(Formula *formula,
+										 AssignmentStack *stack, Assignment a);
+
+/*
+ * Propagate all assignments, that are not propagated yet. Newly implied
+ * assignments are put to the end of the stack, so they are processed within
+ * the same loop.
+ *
+ * Returns the clause which became empty, or InvalidClauseRef if there is no
+ * conflict.
+ */
+static ClauseRef
+unit_propagate(Formula *formula, AssignmentStack *stack)
+{
+	while (stack->qhead < stack->depth)
+	{
+		Assignment	a = stack->data[stack->qhead++];
+		ClauseRef	conflict = propagate_literal_value(formula, stack, a);
+
+		formula->npropagations++;
+		if (conflict != InvalidClauseRef)
+			return conflict;
+	}
+
+	return InvalidClauseRef;
+}
+
+/*
+ * Put literals of all single-literal clauses to the stack at level 0.
+ * Returns the clause, which is empty or contradicts to a previous one, or
+ * InvalidClauseRef if there is none.
+ */
+static ClauseRef
+propagate_unit_clauses(Formula *formula, AssignmentStack *stack)
+{
+	for (int i = 0; i < formula->nclauses; i++)
+	{
+		Clause		*c = ClauseAt(formula, formula->clauses[i]);
+		Assignment	a;
+
+		/* Empty clause cannot be satisfied */
+		if (c->n_literals == 0)
+			return formula->clauses[i];
+
+		if (c->n_literals != 1)
+			continue;
+
+		if (LiteralGivesFalse(formula, c->literals[0]))
+			return formula->clauses[i];
+
+		if (!LiteralIsUnassigned(formula, c->literals[0]))
+			continue;
+
+		a.type = UNIT_PROPAGATION;
+		a.newval = !LiteralIsNegated(c->literals[0]);
+		a.literal_name = LiteralVarIdx(c->literals[0]) + 1;
+		enqueue_assignment(formula, stack, &a, formula->clauses[i]);
+	}
+
+	return InvalidClauseRef;
+}
+
+static unsigned int choose_decision_variable(Formula *formula,
+											 AssignedValue *value);
+
+/*
+ * Choose the next decision variable and the value to try first. Returns
+ * InvalidLiteralName iff all variables are assigned.
+ *
+ * Phase of the variable, if any, takes precedence over the value proposed by
+ * the heuristic.
+ */
+static unsigned int
+find_unassigned_literal(Formula *formula, AssignedValue *value)
+{
+	unsigned int lname = choose_decision_variable(formula, value);
+
+	if (lname != InvalidLiteralName &&
+		formula->variables[lname - 1].phase != VAL_UNASSIGNED)
+		*value = formula->variables[lname - 1].phase;
+
+	return lname;
+}
+
+/*
+ * Pick an unassigned variable according to the decision heuristic. Literal
+ * count heuristics also propose the value, others propose VAL_TRUE.
+ */
+static unsigned int
+choose_decision_variable(Formula *formula, AssignedValue *value)
+{
+	unsigned int lname = InvalidLiteralName;
+	double		best_score = -1.0;
+
+	*value = VAL_TRUE;
+
+	if (formula->order.data != NULL)
+	{
+		while (formula->order.size > 0)
+		{
+			unsigned int var_idx = heap_pop(formula);
+
+			if (formula->variables[var_idx].assigned_value != VAL_UNASSIGNED)
+				continue;
+
+			if (HeuristicUsesCounts(formula->heuristic))
+				literal_count_score(formula, var_idx, value);
+
+			return formula->variables[var_idx].name;
+		}
+
+		return lname;
+	}
+
+	if (formula->unsatisfied_by_size != NULL)
+		follow_short_clause_size(formula);
+
+	for (int i = 0; i < formula->nvariables; i++)
+	{
+		AssignedValue	v_value;
+		double			score;
+
+		if (formula->variables[i].assigned_value != VAL_UNASSIGNED)
+			continue;
+
+		if (formula->heuristic == HEURISTIC_FIRST)
+			return formula->variables[i].name;
+
+		score = literal_count_score(formula, i, &v_value);
+		if (score > best_score)
+		{
+			best_score = score;
+			lname = formula->variables[i].name;
+			*value = v_value;
+		}
+	}
+
+	return lname;
+}
+
+/*
+ * Returns the clause which became empty after assign, or InvalidClauseRef if
+ * there is no such clause.
+ *
+ * Only clauses watching the literal that has just become false are visited.
+ * Each of them either finds another non-false literal to watch, or stays in
+ * the watch list being satisfied, unit or empty. Literals of unit clauses are
+ * put to the stack.
+ */
+static ClauseRef
+propagate_literal_value(Formula *formula, AssignmentStack *stack,
+						Assignment a)
+{
+	/* Negated literal becomes false on VAL_TRUE, positive one on VAL_FALSE */
+	Literal		false_lit = MakeLiteral(a.literal_name - 1,
+										a.newval == VAL_TRUE);
+	ClauseRef	conflict = InvalidClauseRef;
+	unsigned int i, j;
+
+	WatchList *wl = LiteralWatchList(formula, false_lit);
+
+	for (i = 0, j = 0; i < wl->nclauses; i++)
+	{
+		ClauseRef	ref = wl->clauses[i];
+		Clause		*c;
+		Literal		tmp;
+		bool		watch_moved = false;
+
+		if (conflict != InvalidClauseRef)
+		{
+			wl->clauses[j++] = ref;
+			continue;
+		}
+
+		c = ClauseAt(formula, ref);
+
+		if (c->n_literals == 1)
+		{
+			/* Single-literal clause is the only one, that can be empty here */
+			conflict = ref;
+			wl->clauses[j++] = ref;
+			continue;
+		}
+
+		/* Make sure that falsified literal is at position 1 */
+		if (c->literals[0] == false_lit)
+		{
+			c->literals[0] = c->literals[1];
+			c->literals[1] = false_lit;
+		}
+
+		if (LiteralGivesTrue(formula, c->literals[0]))
+		{
+			wl->clauses[j++] = ref;
+			continue;
+		}
+
+		for (int k = 2; k < c->n_literals; k++)
+		{
+			if (LiteralGivesFalse(formula, c->literals[k]))
+				continue;
+
+			tmp = c->literals[1];
+			c->literals[1] = c->literals[k];
+			c->literals[k] = tmp;
+
+			add_watch(LiteralWatchList(formula, c->literals[1]), ref);
+			watch_moved = true;
+			break;
+		}
+
+		if (watch_moved)
+			continue;
+
+		/* Clause is unit or empty, it keeps watching current literal */
+		wl->clauses[j++] = ref;
+
+		if (LiteralGivesFalse(formula, c->literals[0]))
+			conflict = ref;
+		else
+		{
+			Assignment unit = {
+				.type = UNIT_PROPAGATION,
+				.newval = !LiteralIsNegated(c->literals[0]),
+				.literal_name = LiteralVarIdx(c->literals[0]) + 1,
+			};
+
+			enqueue_assignment(formula, stack, &unit, ref);
+		}
+	}
+
+	wl->nclauses = j;
+
+	return conflict;
+}
+
+
+/*
+ * Parallel DPLL splits the search tree by guiding paths. Each decision, whose
+ * second branch is not tried yet, is an open subtree: its guiding path is the
+ * list of decisions above it followed by the flipped decision. Each thread
+ * publishes guiding paths of its decisions in its own deque. The owner takes
+ * them from the bottom, where the latest decision is, when it flips it. Idle
+ * threads steal from the top, where the oldest decision - the largest
+ * subtree - is.
+ *
+ * Deques are Chase-Lev ones: the owner and thieves agree on the last item by
+ * compare-and-swap of 'top', so there is no lock.
+ */
+#define WORK_MAX_PATH	64		/* deeper decisions are not published */
+#define WORK_DEQUE_SIZE	128		/* power of two, above WORK_MAX_PATH */
+
+typedef struct GuidingPath
+{
+	atomic_int		length;
+	atomic_uint		literals[WORK_MAX_PATH];
+}		GuidingPath;
+
+typedef struct WorkDeque
+{
+	GuidingPath		paths[WORK_DEQUE_SIZE];
+	atomic_llong	top;		/* the oldest path, taken by thieves */
+	atomic_llong	bottom;		/* next to the latest path of the owner */
+}		WorkDeque;
+
+struct WorkSharing
+{
+	WorkDeque  *deques;		/* a deque per thread */
+	int			ndeques;
+	int			self;		/* deque of this thread */
+
+	/*
+	 * Threads, which have a subtree to explore or try to steal one. Search
+	 * space is exhausted, once it drops to 0.
+	 */
+	atomic_int *nbusy;
+	bool		busy;		/* this thread is counted in 'nbusy' */
+	bool		root;		/* this thread has to start with the whole tree */
+
+	Literal		path[WORK_MAX_PATH];	/* stolen guiding path */
+};
+
+/*
+ * Publish the guiding path of the second branch of the latest decision.
+ */
+static void
+publish_decision(WorkSharing *work, AssignmentStack *stack)
+{
+	WorkDeque  *deque = &work->deques[work->self];
+	unsigned int level = decision_level(stack);
+	long long	b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	GuidingPath *path = &deque->paths[b & (WORK_DEQUE_SIZE - 1)];
+
+	if (level > WORK_MAX_PATH)
+		return;
+
+	/* Deque has a path per published level, so it never overflows */
+	for (unsigned int i = 0; i < level; i++)
+	{
+		Assignment *a = &stack->data[stack->level_start[i]];
+		Literal		l = MakeLiteral(a->literal_name - 1, a->newval == VAL_FALSE);
+
+		atomic_store_explicit(&path->literals[i], (i + 1 < level) ? l : l ^ 1,
+							  memory_order_relaxed);
+	}
+	atomic_store_explicit(&path->length, level, memory_order_relaxed);
+
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+}
+
+/*
+ * Take back the latest published path. Returns false iff it is stolen
+ * already, together with all the older ones.
+ */
+static bool
+work_pop(WorkSharing *work)
+{
+	WorkDeque  *deque = &work->deques[work->self];
+	long long	b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+	long long	t;
+	bool		taken = true;
+
+	atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+	if (t > b)
+		taken = false;
+	else if (t == b)
+		/* The last path, thieves may be taking it right now */
+		taken = atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+														memory_order_seq_cst,
+														memory_order_relaxed);
+	else
+		return true;
+
+	atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+	return taken;
+}
+
+/*
+ * Steal the oldest path of the deque into 'literals'. Returns its length, or
+ * -1 if there is none or another thread has taken it first.
+ */
+static int
+work_steal(WorkDeque *deque, Literal *literals)
+{
+	long long	t = atomic_load_explicit(&deque->top, memory_order_acquire);
+	long long	b;
+	GuidingPath *path;
+	int			length;
+
+	atomic_thread_fence(memory_order_seq_cst);
+	b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+	if (t >= b)
+		return -1;
+
+	/* Path may be overwritten meanwhile, then the swap below fails */
+	path = &deque->paths[t & (WORK_DEQUE_SIZE - 1)];
+	length = atomic_load_explicit(&path->length, memory_order_relaxed);
+	if (length > WORK_MAX_PATH)
+		length = WORK_MAX_PATH;
+	for (int i = 0; i < length; i++)
+		literals[i] = atomic_load_explicit(&path->literals[i],
+										   memory_order_relaxed);
+
+	if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+												 memory_order_seq_cst,
+												 memory_order_relaxed))
+		return -1;
+
+	return length;
+}
+
+/*
+ * Find a subtree to explore, waiting for other threads to publish one. The
+ * whole tree is explored first by the root thread.
+ *
+ * Returns length of the guiding path, or -1 if the search space is exhausted
+ * or the search is interrupted.
+ */
+static int
+steal_guiding_path(Formula *formula, const Literal **path)
+{
+	WorkSharing *work = formula->work;
+
+	*path = work->path;
+	if (work->root)
+	{
+		work->root = false;
+		return 0;
+	}
+
+	while (true)
+	{
+		if (work->busy)
+		{
+			int		start = (int) (next_random(formula) % work->ndeques);
+
+			for (int i = 0; i < work->ndeques; i++)
+			{
+				int		victim = (start + i) % work->ndeques;
+				int		length;
+
+				if (victim != work->self &&
+					(length = work_steal(&work->deques[victim], work->path)) >= 0)
+					return length;
+			}
+
+			atomic_fetch_sub(work->nbusy, 1);
+			work->busy = false;
+		}
+
+		/* Idle thread is not counted, so others see when the work is over */
+		while (true)
+		{
+			bool	published = false;
+
+			if (atomic_load(work->nbusy) == 0 ||
+				(formula->interrupt != NULL &&
+				 atomic_load_explicit(formula->interrupt, memory_order_relaxed)))
+				return -1;
+
+			for (int i = 0; i < work->ndeques && !published; i++)
+				published =
+					atomic_load_explicit(&work->deques[i].top, memory_order_relaxed) <
+					atomic_load_explicit(&work->deques[i].bottom, memory_order_relaxed);
+
+			if (published)
+				break;
+
+			sched_yield();
+		}
+
+		atomic_fetch_add(work->nbusy, 1);
+		work->busy = true;
+	}
+}
+
+/*
+ * Chronological backtracking: revert the latest decision, whose second branch
+ * is not tried yet, and try it.
+ *
+ * Returns false iff all branches are exhausted. Branches published for other
+ * threads count as exhausted, once they are stolen.
+ */
+static bool
+flip_last_decision(Formula *formula, AssignmentStack *stack)
+{
+	unsigned int level = decision_level(stack);
+	Assignment	a;
+
+	while (level > 0)
+	{
+		a = stack->data[stack->level_start[level - 1]];
+
+		if (a.type == VAL_PROPAGATION)
+			break;
+
+		level--;
+	}
+
+	if (level == 0)
+		return false;
+
+	if (formula->work != NULL && level <= WORK_MAX_PATH &&
+		!work_pop(formula->work))
+		return false;
+
+	backtrack(formula, stack, level - 1);
+
+	a.newval = !a.newval;
+	a.type = FLIP_PROPAGATION;
+	new_decision_level(stack);
+	enqueue_assignment(formula, stack, &a, InvalidClauseRef);
+
+	return true;
+}
+
+/*
+ * Proof of unsatisfiability is a log of learned and deleted clauses, which
+ * can be verified by an independent checker. DRAT lists the clauses only.
+ * LRAT also numbers clauses (clauses of the formula by their order in the
+ * input) and gives hints: the clauses, that become unit one after another and
+ * then empty, once literals of the new clause are falsified. Both come in text
+ * and binary variants.
+ */
+typedef enum ProofFormat
+{
+	PROOF_DRAT = 1,
+	PROOF_BINARY_DRAT = 2,
+	PROOF_LRAT = 3,
+	PROOF_BINARY_LRAT = 4,
+}		ProofFormat;
+
+#define ProofHasHints(proof) \
+	((proof)->format == PROOF_LRAT || (proof)->format == PROOF_BINARY_LRAT)
+#define ProofIsBinary(proof) \
+	((proof)->format == PROOF_BINARY_DRAT || (proof)->format == PROOF_BINARY_LRAT)
+
+/*
+ * Proof is formatted by the search thread into one buffer, while the other
+ * buffer is written to the file by a separate thread. Search waits only if it
+ * fills the buffer before the previous one is written.
+ */
+#define PROOF_BUFFER_SIZE	(1 << 22)
+
+/* Enough for any single number with its separator */
+#define PROOF_MAX_ITEM_SIZE	24
+
+struct ProofWriter
+{
+	ProofFormat	format;
+	int			fd;
+	char	   *buf[2];
+	int			current;	/* buffer being filled */
+	size_t		len;
+
+	/* Fields below are shared with the writer thread and protected by lock */
+	pthread_t	thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char	   *pending;	/* buffer to be written, if any */
+	size_t		pending_len;
+	bool		done;		/* no more buffers will come */
+	bool		failed;
+
+	/* Last clause ID used, for LRAT */
+	unsigned long long last_id;
+
+	/* IDs of the clauses, that justify the next one, in reverse order */
+	unsigned long long *hints;
+	size_t		nhints;
+	size_t		hints_capacity;
+};
+
+static void *
+proof_writer_main(void *arg)
+{
+	ProofWriter *proof = (ProofWriter *) arg;
+
+	pthread_mutex_lock(&proof->lock);
+	while (true)
+	{
+		bool	ok;
+
+		while (proof->pending == NULL && !proof->done)
+			pthread_cond_wait(&proof->cond, &proof->lock);
+
+		if (proof->pending == NULL)
+			break;
+
+		pthread_mutex_unlock(&proof->lock);
+		ok = write_block(proof->fd, proof->pending, proof->pending_len);
+		pthread_mutex_lock(&proof->lock);
+
+		proof->failed = proof->failed || !ok;
+		proof->pending = NULL;
+		pthread_cond_broadcast(&proof->cond);
+	}
+	pthread_mutex_unlock(&proof->lock);
+
+	return NULL;
+}
+
+/*
+ * Hand the filled buffer to the writer thread and continue with the other one.
+ */
+static void
+proof_flush(ProofWriter *proof)
+{
+	pthread_mutex_lock(&proof->lock);
+	while (proof->pending != NULL)
+		pthread_cond_wait(&proof->cond, &proof->lock);
+
+	proof->pending = proof->buf[proof->current];
+	proof->pending_len = proof->len;
+	pthread_cond_broadcast(&proof->cond);
+	pthread_mutex_unlock(&proof->lock);
+
+	proof->current ^= 1;
+	proof->len = 0;
+}
+
+/*
+ * Start writing proof to the file at 'path'. 'last_id' is the number of
+ * clauses in the formula. Returns NULL on error, it is reported.
+ */
+static ProofWriter *
+proof_open(const char *path, ProofFormat format, unsigned long long last_id)
+{
+	ProofWriter *proof;
+
+	if ((proof = (ProofWriter *) calloc(1, sizeof(ProofWriter))) == NULL ||
+		(proof->buf[0] = (char *) malloc(PROOF_BUFFER_SIZE)) == NULL ||
+		(proof->buf[1] = (char *) malloc(PROOF_BUFFER_SIZE)) == NULL)
+	{
+		if (proof != NULL)
+			free(proof->buf[0]);
+		free(proof);
+		ereport("Cannot allocate memory for proof");
+		return NULL;
+	}
+
+	proof->format = format;
+	proof->last_id = last_id;
+
+	if ((proof->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		ereport("Cannot create proof file");
+		free(proof->buf[0]);
+		free(proof->buf[1]);
+		free(proof);
+		return NULL;
+	}
+
+	pthread_mutex_init(&proof->lock, NULL);
+	pthread_cond_init(&proof->cond, NULL);
+
+	if (pthread_create(&proof->thread, NULL, proof_writer_main, proof) != 0)
+	{
+		errno = 0;
+		ereport("Cannot start proof writer");
+		close(proof->fd);
+		free(proof->buf[0]);
+		free(proof->buf[1]);
+		free(proof);
+		return NULL;
+	}
+
+	return proof;
+}
+
+/*
+ * Write the rest of the proof and release the writer. Returns false iff any
+ * part of the proof could not be written, it is reported.
+ */
+static bool
+proof_close(ProofWriter *proof)
+{
+	bool	ok;
+
+	if (proof->len > 0)
+		proof_flush(proof);
+
+	pthread_mutex_lock(&proof->lock);
+	proof->done = true;
+	pthread_cond_broadcast(&proof->cond);
+	pthread_mutex_unlock(&proof->lock);
+	pthread_join(proof->thread, NULL);
+
+	ok = !proof->failed;
+	if (close(proof->fd) != 0)
+		ok = false;
+	if (!ok)
+		ereport("Cannot write proof");
+
+	pthread_mutex_destroy(&proof->lock);
+	pthread_cond_destroy(&proof->cond);
+	free(proof->buf[0]);
+	free(proof->buf[1]);
+	free(proof->hints);
+	free(proof);
+
+	return ok;
+}
+
+static void
+proof_put_char(ProofWriter *proof, char c)
+{
+	if (proof->len + PROOF_MAX_ITEM_SIZE > PROOF_BUFFER_SIZE)
+		proof_flush(proof);
+
+	proof->buf[proof->current][proof->len++] = c;
+}
+
+/*
+ * Put a literal, a clause ID or a terminating 0. Text numbers are followed by
+ * a space. Binary ones are mapped to 2 * |val| + (val < 0) and written as
+ * varints.
+ */
+static void
+proof_put_number(ProofWriter *proof, long long val)
+{
+	char	   *dst;
+
+	if (proof->len + PROOF_MAX_ITEM_SIZE > PROOF_BUFFER_SIZE)
+		proof_flush(proof);
+
+	dst = proof->buf[proof->current] + proof->len;
+
+	if (ProofIsBinary(proof))
+	{
+		unsigned long long mapped = (val < 0) ?
+			2 * -(unsigned long long) val + 1 : 2 * (unsigned long long) val;
+
+		proof->len += encode_varint((unsigned char *) dst, mapped);
+	}
+	else
+	{
+		char	digits[PROOF_MAX_ITEM_SIZE];
+		char   *p = format_decimal(digits + sizeof(digits) - 1, val);
+
+		digits[sizeof(digits) - 1] = ' ';
+		memcpy(dst, p, digits + sizeof(digits) - p);
+		proof->len += digits + sizeof(digits) - p;
+	}
+}
+
+static void
+proof_end_line(ProofWriter *proof)
+{
+	proof_put_number(proof, 0);
+	if (!ProofIsBinary(proof))
+		proof->buf[proof->current][proof->len - 1] = '\n';
+}
+
+static void
+proof_put_literal(ProofWriter *proof, Literal l)
+{
+	long long name = LiteralVarIdx(l) + 1;
+
+	proof_put_number(proof, LiteralIsNegated(l) ? -name : name);
+}
+
+static void
+proof_add_hint(ProofWriter *proof, unsigned long long id)
+{
+	if (proof->nhints >= proof->hints_capacity)
+	{
+		proof->hints_capacity = (proof->hints_capacity == 0) ?
+			64 : proof->hints_capacity * 2;
+		proof->hints = (unsigned long long *) realloc(proof->hints,
+			sizeof(unsigned long long) * proof->hints_capacity);
+
+		if (proof->hints == NULL)
+		{
+			printf("cannot allocate memory for proof hints\n");
+			exit(1);
+		}
+	}
+
+	proof->hints[proof->nhints++] = id;
+}
+
+/*
+ * Log the derived clause with hints collected so far. Returns its ID.
+ */
+static unsigned long long
+proof_add_clause(ProofWriter *proof, Literal *literals, int n_literals)
+{
+	unsigned long long id = ++proof->last_id;
+
+	if (ProofIsBinary(proof))
+		proof_put_char(proof, 'a');
+	if (ProofHasHints(proof))
+		proof_put_number(proof, id);
+
+	for (int i = 0; i < n_literals; i++)
+		proof_put_literal(proof, literals[i]);
+
+	if (ProofHasHints(proof))
+	{
+		proof_put_number(proof, 0);
+		for (size_t i = proof->nhints; i > 0; i--)
+			proof_put_number(proof, proof->hints[i - 1]);
+	}
+
+	proof_end_line(proof);
+	proof->nhints = 0;
+
+	return id;
+}
+
+static void
+proof_delete_clause(ProofWriter *proof, Clause *c, unsigned long long id)
+{
+	/* Text LRAT deletion starts with an ID, the last one is conventional */
+	if (!ProofIsBinary(proof) && ProofHasHints(proof))
+		proof_put_number(proof, proof->last_id);
+
+	if (ProofIsBinary(proof))
+		proof_put_char(proof, 'd');
+	else
+	{
+		proof_put_char(proof, 'd');
+		proof_put_char(proof, ' ');
+	}
+
+	if (ProofHasHints(proof))
+		proof_put_number(proof, id);
+	else
+	{
+		for (int i = 0; i < c->n_literals; i++)
+			proof_put_literal(proof, c->literals[i]);
+	}
+
+	proof_end_line(proof);
+}
+
+/*
+ * ID of the clause for LRAT. Clauses of the formula and learned ones are
+ * listed in the order of their places in the arena, so it is found by binary
+ * search.
+ */
+static unsigned long long
+clause_id(Formula *formula, ClauseRef ref)
+{
+	ClauseRef  *refs = formula->clauses;
+	int			lo = 0;
+	int			hi = formula->nclauses;
+	bool		learnt = (formula->nlearnts > 0 && ref >= formula->learnts[0]);
+
+	if (learnt)
+	{
+		refs = formula->learnts;
+		hi = formula->nlearnts;
+	}
+
+	while (hi - lo > 1)
+	{
+		int mid = lo + (hi - lo) / 2;
+
+		if (refs[mid] <= ref)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return learnt ? formula->learnt_ids[lo] : (unsigned long long) lo + 1;
+}
+
+/*
+ * Add hints for variables assigned at level 0, which are marked as seen.
+ * Marks are cleared. Reasons are added from the latest assignment, so in the
+ * reverse order hints of the earlier ones go first, as LRAT requires.
+ */
+static void
+proof_add_root_hints(Formula *formula, AssignmentStack *stack, int nmarked)
+{
+	unsigned int depth = (stack->nlevels > 0) ?
+		stack->level_start[0] : stack->depth;
+
+	while (nmarked > 0 && depth > 0)
+	{
+		Variable   *v = &formula->variables[stack->data[--depth].literal_name - 1];
+		Clause	   *c;
+
+		if (!v->seen)
+			continue;
+
+		v->seen = false;
+		nmarked--;
+		proof_add_hint(formula->proof, clause_id(formula, v->reason));
+
+		c = ClauseAt(formula, v->reason);
+		for (int i = 0; i < c->n_literals; i++)
+		{
+			Variable *u = LiteralVariable(formula, c->literals[i]);
+
+			if (u != v && !u->seen)
+			{
+				u->seen = true;
+				nmarked++;
+			}
+		}
+	}
+}
+
+/*
+ * Log the empty clause, when clause 'conflict' is falsified at level 0.
+ */
+static void
+proof_add_empty_clause(Formula *formula, AssignmentStack *stack,
+					   ClauseRef conflict)
+{
+	if (formula->proof == NULL)
+		return;
+
+	if (ProofHasHints(formula->proof))
+	{
+		Clause *c = ClauseAt(formula, conflict);
+		int		nmarked = 0;
+
+		proof_add_hint(formula->proof, clause_id(formula, conflict));
+		for (int i = 0; i < c->n_literals; i++)
+		{
+			Variable *v = LiteralVariable(formula, c->literals[i]);
+
+			if (!v->seen)
+			{
+				v->seen = true;
+				nmarked++;
+			}
+		}
+
+		proof_add_root_hints(formula, stack, nmarked);
+	}
+
+	proof_add_clause(formula->proof, NULL, 0);
+}
+
+static ClauseRef
+add_learnt_clause(Formula *formula, Literal *literals, int n_literals,
+				  unsigned int lbd)
+{
+	ClauseRef	ref;
+	Clause		*c;
+
+	if (formula->nlearnts >= formula->learnts_capacity)
+	{
+		formula->learnts_capacity = (formula->learnts_capacity == 0) ?
+			64 : formula->learnts_capacity * 2;
+		formula->learnts = (ClauseRef *) realloc(formula->learnts,
+			sizeof(ClauseRef) * formula->learnts_capacity);
+
+		if (formula->proof != NULL && ProofHasHints(formula->proof))
+			formula->learnt_ids = (unsigned long long *)
+				realloc(formula->learnt_ids, sizeof(unsigned long long) *
+						formula->learnts_capacity);
+
+		if (formula->learnts == NULL ||
+			(formula->proof != NULL && ProofHasHints(formula->proof) &&
+			 formula->learnt_ids == NULL))
+		{
+			printf("cannot allocate memory for learned clauses\n");
+			exit(1);
+		}
+	}
+
+	/* Hints, if needed, are already collected by the caller */
+	if (formula->proof != NULL)
+	{
+		unsigned long long id = proof_add_clause(formula->proof, literals,
+												 n_literals);
+
+		if (formula->learnt_ids != NULL)
+			formula->learnt_ids[formula->nlearnts] = id;
+	}
+
+	ref = alloc_clause(formula, n_literals);
+	c = ClauseAt(formula, ref);
+
+	memcpy(c->literals, literals, sizeof(Literal) * n_literals);
+	c->learnt = true;
+	c->lbd = (lbd < CLAUSE_MAX_LBD) ? lbd : CLAUSE_MAX_LBD;
+	c->tier = ClauseTier(lbd);
+	c->activity = formula->clause_activity_inc;
+	formula->learnts[formula->nlearnts++] = ref;
+
+	add_watch(LiteralWatchList(formula, c->literals[0]), ref);
+	if (n_literals > 1)
+		add_watch(LiteralWatchList(formula, c->literals[1]), ref);
+
+	return ref;
+}
+
+/*
+ * Solvers of a portfolio share short learned clauses with low LBD. Each solver
+ * exports them into its own ring, which is read by all the others. The ring
+ * is never locked: the writer overwrites the oldest clauses, and a reader,
+ * which falls behind, loses them. Each slot is guarded by a sequence number
+ * like a seqlock, so a reader detects clauses overwritten while it copied
+ * them.
+ */
+#define SHARE_RING_SIZE		4096	/* power of two */
+#define SHARE_MAX_LITERALS	16
+
+/*
+ * Export limit on LBD is adjusted every SHARE_ADJUST_INTERVAL conflicts to
+ * keep the number of exported clauses between the bounds.
+ */
+#define SHARE_ADJUST_INTERVAL	1000
+#define SHARE_MIN_EXPORTS		10
+#define SHARE_MAX_EXPORTS		100
+#define SHARE_INITIAL_LBD		2
+#define SHARE_MAX_LBD			8
+
+typedef struct SharedClause
+{
+	/* 2 * (position + 1) once written, odd while being written */
+	atomic_ullong	seq;
+	atomic_uint		n_literals;
+	atomic_uint		lbd;
+	atomic_uint		literals[SHARE_MAX_LITERALS];
+}		SharedClause;
+
+typedef struct ClauseRing
+{
+	SharedClause	slots[SHARE_RING_SIZE];
+	atomic_ullong	head;	/* number of clauses ever written */
+}		ClauseRing;
+
+struct ClauseExchange
+{
+	ClauseRing *rings;		/* a ring per solver */
+	int			nrings;
+	int			self;		/* ring of this solver */
+
+	/* Positions of this solver in rings of the others */
+	unsigned long long *tails;
+
+	unsigned int lbd_limit;
+	unsigned int nexported;		/* in the current interval */
+	unsigned int nconflicts;	/* in the current interval */
+};
+
+/*
+ * Offer the learned clause to other solvers. Never waits for them.
+ */
+static void
+export_learnt_clause(ClauseExchange *exchange, Literal *literals,
+					 int n_literals, unsigned int lbd)
+{
+	ClauseRing *ring = &exchange->rings[exchange->self];
+
+	if (++exchange->nconflicts >= SHARE_ADJUST_INTERVAL)
+	{
+		if (exchange->nexported < SHARE_MIN_EXPORTS &&
+			exchange->lbd_limit < SHARE_MAX_LBD)
+			exchange->lbd_limit++;
+		else if (exchange->nexported > SHARE_MAX_EXPORTS &&
+				 exchange->lbd_limit > 1)
+			exchange->lbd_limit--;
+
+		exchange->nconflicts = 0;
+		exchange->nexported = 0;
+	}
+
+	if (lbd <= exchange->lbd_limit && n_literals <= SHARE_MAX_LITERALS)
+	{
+		/* Only this solver writes to its ring */
+		unsigned long long pos = atomic_load_explicit(&ring->head,
+													  memory_order_relaxed);
+		SharedClause *slot = &ring->slots[pos & (SHARE_RING_SIZE - 1)];
+
+		atomic_store_explicit(&slot->seq, 2 * pos + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+
+		atomic_store_explicit(&slot->n_literals, n_literals,
+							  memory_order_relaxed);
+		atomic_store_explicit(&slot->lbd, lbd, memory_order_relaxed);
+		for (int i = 0; i < n_literals; i++)
+			atomic_store_explicit(&slot->literals[i], literals[i],
+								  memory_order_relaxed);
+
+		atomic_store_explicit(&slot->seq, 2 * pos + 2, memory_order_release);
+		atomic_store_explicit(&ring->head, pos + 1, memory_order_release);
+
+		exchange->nexported++;
+	}
+}
+
+/*
+ * Add a clause learned by another solver. Must be called at level 0 after
+ * propagation, so literals false at level 0 are dropped and the others are
+ * unassigned.
+ *
+ * Returns false iff the clause is falsified, so the formula is unsatisfiable.
+ */
+static bool
+import_clause(Formula *formula, AssignmentStack *stack, Literal *literals,
+			  int n_literals, unsigned int lbd)
+{
+	int		n = 0;
+
+	for (int i = 0; i < n_literals; i++)
+	{
+		if (LiteralGivesTrue(formula, literals[i]))
+			return true;
+		if (LiteralIsUnassigned(formula, literals[i]))
+			literals[n++] = literals[i];
+	}
+
+	if (n == 0)
+		return false;
+
+	if (n == 1)
+	{
+		Assignment a = {
+			.type = UNIT_PROPAGATION,
+			.newval = !LiteralIsNegated(literals[0]),
+			.literal_name = LiteralVarIdx(literals[0]) + 1,
+		};
+
+		enqueue_assignment(formula, stack, &a,
+						   add_learnt_clause(formula, literals, 1, 1));
+	}
+	else
+		add_learnt_clause(formula, literals, n,
+						  (lbd < (unsigned int) n) ? lbd : (unsigned int) n - 1);
+
+	return true;
+}
+
+/*
+ * Add clauses exported by other solvers since the last call. Units are put to
+ * the stack and have to be propagated.
+ *
+ * Returns false iff an imported clause is falsified.
+ */
+static bool
+import_shared_clauses(Formula *formula, AssignmentStack *stack)
+{
+	ClauseExchange *exchange = formula->exchange;
+	Literal		literals[SHARE_MAX_LITERALS];
+
+	for (int r = 0; r < exchange->nrings; r++)
+	{
+		ClauseRing *ring = &exchange->rings[r];
+		unsigned long long head;
+		unsigned long long *tail = &exchange->tails[r];
+
+		if (r == exchange->self)
+			continue;
+
+		head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+		/* Clauses, which are overwritten already, are lost */
+		if (head - *tail > SHARE_RING_SIZE)
+			*tail = head - SHARE_RING_SIZE;
+
+		for (; *tail < head; (*tail)++)
+		{
+			SharedClause *slot = &ring->slots[*tail & (SHARE_RING_SIZE - 1)];
+			unsigned long long seq;
+			unsigned int n_literals;
+			unsigned int lbd;
+
+			seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+			if (seq != 2 * *tail + 2)
+				continue;
+
+			n_literals = atomic_load_explicit(&slot->n_literals,
+											  memory_order_relaxed);
+			lbd = atomic_load_explicit(&slot->lbd, memory_order_relaxed);
+			for (unsigned int i = 0; i < n_literals && i < SHARE_MAX_LITERALS; i++)
+				literals[i] = atomic_load_explicit(&slot->literals[i],
+												   memory_order_relaxed);
+
+			/* Writer has not started to overwrite the slot while it was read */
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq)
+				continue;
+
+			if (!import_clause(formula, stack, literals, n_literals, lbd))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Literal block distance: number of distinct decision levels among literals of
+ * the clause. The lower it is, the more useful clause is expected to be.
+ */
+static unsigned int
+compute_lbd(Formula *formula, Literal *literals, int n_literals)
+{
+	unsigned int lbd = 0;
+
+	if (++formula->level_stamp == 0)
+	{
+		memset(formula->level_marks, 0,
+			   sizeof(unsigned int) * ((size_t) formula->nvariables + 1));
+		formula->level_stamp = 1;
+	}
+
+	for (int i = 0; i < n_literals; i++)
+	{
+		unsigned int level = LiteralVariable(formula, literals[i])->level;
+
+		if (formula->level_marks[level] != formula->level_stamp)
+		{
+			formula->level_marks[level] = formula->level_stamp;
+			lbd++;
+		}
+	}
+
+	return lbd;
+}
+
+/*
+ * Learned clause participated in a conflict. Make it more valuable and
+ * recompute its LBD, it may become lower under the current assignment.
+ */
+static void
+bump_clause(Formula *formula, Clause *c)
+{
+	unsigned int lbd;
+
+	if (!c->learnt)
+		return;
+
+	c->used = true;
+
+	if ((c->activity += formula->clause_activity_inc) > CLAUSE_RESCALE_LIMIT)
+	{
+		for (int i = 0; i < formula->nlearnts; i++)
+			ClauseAt(formula, formula->learnts[i])->activity /=
+				CLAUSE_RESCALE_LIMIT;
+		formula->clause_activity_inc /= CLAUSE_RESCALE_LIMIT;
+	}
+
+	if (c->tier != TIER_CORE &&
+		(lbd = compute_lbd(formula, c->literals, c->n_literals)) < c->lbd)
+	{
+		c->lbd = lbd;
+		if (ClauseTier(lbd) < c->tier)
+			c->tier = ClauseTier(lbd);
+	}
+}
+
+/*
+ * Derive a clause from the conflict, that has exactly one literal assigned at
+ * the current decision level (first unique implication point). Then backjump
+ * to the highest level among the other literals, where the learned clause
+ * becomes unit, and assign its first literal.
+ *
+ * Returns LBD of the learned clause. Must not be called at level 0: conflict
+ * there means that formula is unsatisfiable.
+ */
+static unsigned int
+learn_from_conflict(Formula *formula, AssignmentStack *stack,
+					ClauseRef conflict)
+{
+	Literal		*learnt = formula->learnt_buf;
+	int			nlearnt = 1; /* position 0 is for the asserting literal */
+	int			npending = 0;
+	unsigned int level = decision_level(stack);
+	unsigned int backjump_level = 0;
+	unsigned int depth = stack->depth;
+	Variable	*uip = NULL;
+	Clause		*c = ClauseAt(formula, conflict);
+	Assignment	a;
+	unsigned int lbd;
+	bool		hints = (formula->proof != NULL &&
+						 ProofHasHints(formula->proof));
+	int			nroot = 0;	/* level 0 variables marked for hints */
+
+	do
+	{
+		bump_clause(formula, c);
+
+		/* Clauses are resolved from the conflict back along the stack */
+		if (hints)
+			proof_add_hint(formula->proof, clause_id(formula,
+					(uip == NULL) ? conflict : uip->reason));
+
+		/* Literal 0 of the reason clause is the one it implied */
+		for (int i = (uip == NULL) ? 0 : 1; i < c->n_literals; i++)
+		{
+			Variable *v = LiteralVariable(formula, c->literals[i]);
+
+			if (v->seen)
+				continue;
+
+			/* Literals false at level 0 are dropped, LRAT has to justify it */
+			if (v->level == 0)
+			{
+				if (hints)
+				{
+					v->seen = true;
+					nroot++;
+				}
+				continue;
+			}
+
+			v->seen = true;
+			bump_variable_activity(formula, v);
+
+			if (v->level >= level)
+				npending++;
+			else
+				learnt[nlearnt++] = c->literals[i];
+		}
+
+		/* Take the latest assigned variable involved into the conflict */
+		do
+			uip = &formula->variables[stack->data[--depth].literal_name - 1];
+		while (!uip->seen);
+
+		uip->seen = false;
+		if (npending > 1)
+			c = ClauseAt(formula, uip->reason);
+	} while (--npending > 0);
+
+	learnt[0] = MakeLiteral(uip->name - 1, uip->assigned_value == VAL_TRUE);
+
+	if (nroot > 0)
+		proof_add_root_hints(formula, stack, nroot);
+
+	for (int i = 1; i < nlearnt; i++)
+	{
+		Variable *v = LiteralVariable(formula, learnt[i]);
+
+		v->seen = false;
+
+		/* Literal with the highest level is watched along with asserting one */
+		if (v->level > backjump_level)
+		{
+			Literal tmp = learnt[1];
+
+			learnt[1] = learnt[i];
+			learnt[i] = tmp;
+			backjump_level = v->level;
+		}
+	}
+
+	lbd = compute_lbd(formula, learnt, nlearnt);
+
+	if (formula->exchange != NULL)
+		export_learnt_clause(formula->exchange, learnt, nlearnt, lbd);
+
+	decay_variable_activities(formula);
+	formula->clause_activity_inc /= CLAUSE_ACTIVITY_DECAY;
+	backtrack(formula, stack, backjump_level);
+
+	a.type = UNIT_PROPAGATION;
+	a.newval = !LiteralIsNegated(learnt[0]);
+	a.literal_name = uip->name;
+	enqueue_assignment(formula, stack, &a,
+					   add_learnt_clause(formula, learnt, nlearnt, lbd));
+
+	return lbd;
+}
+
+/*
+ * Clause is the reason of the current value of its first literal, so it
+ * cannot be deleted.
+ */
+static bool
+clause_is_locked(Formula *formula, ClauseRef ref)
+{
+	Literal first = ClauseAt(formula, ref)->literals[0];
+
+	return !LiteralIsUnassigned(formula, first) &&
+		LiteralVariable(formula, first)->reason == ref;
+}
+
+static bool
+clause_is_satisfied_at_root(Formula *formula, Clause *c)
+{
+	for (int i = 0; i < c->n_literals; i++)
+	{
+		if (LiteralGivesTrue(formula, c->literals[i]) &&
+			LiteralVariable(formula, c->literals[i])->level == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/* Least active clauses go first, ties are broken by higher LBD */
+static int
+compare_clauses_by_value(const void *a, const void *b)
+{
+	const Clause *ca = *(Clause * const *) a;
+	const Clause *cb = *(Clause * const *) b;
+
+	if (ca->activity != cb->activity)
+		return (ca->activity < cb->activity) ? -1 : 1;
+
+	return (ca->lbd > cb->lbd) ? -1 : (ca->lbd < cb->lbd);
+}
+
+/*
+ * Delete learned clauses, that are not expected to be useful anymore: half of
+ * the local tier with least activity and all clauses satisfied at level 0.
+ * Unused tier2 clauses are moved to the local tier.
+ *
+ * Deleted clauses are removed from watch lists, and remaining learned clauses
+ * are moved down in the arena to fill the gaps, so it stays compact. Watch
+ * lists and reasons are updated to point to the new places.
+ */
+static void
+reduce_learnt_clauses(Formula *formula)
+{
+	Clause	**candidates;
+	int		ncandidates = 0;
+	int		j = 0;
+	ClauseRef learnts_start;
+	ClauseRef to;
+
+	if (formula->nlearnts == 0)
+		return;
+
+	if ((candidates = (Clause **)
+			malloc(sizeof(Clause *) * formula->nlearnts)) == NULL)
+	{
+		printf("cannot allocate memory for learned clauses reduction\n");
+		exit(1);
+	}
+
+	for (int i = 0; i < formula->nlearnts; i++)
+	{
+		Clause *c = ClauseAt(formula, formula->learnts[i]);
+
+		if (clause_is_locked(formula, formula->learnts[i]))
+			continue;
+
+		if (clause_is_satisfied_at_root(formula, c))
+			c->deleted = true;
+		else if (c->tier == TIER_2 && !c->used)
+			c->tier = TIER_LOCAL;
+		else if (c->tier == TIER_LOCAL && !c->used)
+			candidates[ncandidates++] = c;
+
+		c->used = false;
+	}
+
+	qsort(candidates, ncandidates, sizeof(Clause *), compare_clauses_by_value);
+	for (int i = 0; i < ncandidates / 2; i++)
+		candidates[i]->deleted = true;
+
+	free(candidates);
+
+	/* Learned clauses follow the clauses of the formula in the arena */
+	learnts_start = formula->learnts[0];
+	to = learnts_start;
+
+	for (int i = 0; i < formula->nlearnts; i++)
+	{
+		Clause *c = ClauseAt(formula, formula->learnts[i]);
+
+		if (c->deleted)
+			continue;
+
+		c->moved_to = to;
+		to += ClauseWords(c->n_literals);
+	}
+
+	/* Drop deleted clauses from all watch lists and update the others */
+	for (int i = 0; i < formula->nvariables; i++)
+	{
+		Variable *v = &formula->variables[i];
+
+		for (int k = 0; k < 2; k++)
+		{
+			WatchList *wl = &v->watches[k];
+			unsigned int n = 0;
+
+			for (unsigned int w = 0; w < wl->nclauses; w++)
+			{
+				ClauseRef ref = wl->clauses[w];
+
+				if (ref < learnts_start)
+					wl->clauses[n++] = ref;
+				else if (!ClauseAt(formula, ref)->deleted)
+					wl->clauses[n++] = ClauseAt(formula, ref)->moved_to;
+			}
+
+			wl->nclauses = n;
+		}
+
+		/* Reasons are locked, so they are never deleted */
+		if (v->assigned_value != VAL_UNASSIGNED &&
+			v->reason != InvalidClauseRef && v->reason >= learnts_start)
+			v->reason = ClauseAt(formula, v->reason)->moved_to;
+	}
+
+	/* New places are below the old ones, so clauses are moved in order */
+	for (int i = 0; i < formula->nlearnts; i++)
+	{
+		ClauseRef	ref = formula->learnts[i];
+		Clause		*c = ClauseAt(formula, ref);
+
+		if (c->deleted)
+		{
+			if (formula->proof != NULL)
+				proof_delete_clause(formula->proof, c,
+									(formula->learnt_ids != NULL) ?
+									formula->learnt_ids[i] : 0);
+			continue;
+		}
+
+		if (formula->learnt_ids != NULL)
+			formula->learnt_ids[j] = formula->learnt_ids[i];
+		formula->learnts[j++] = c->moved_to;
+		memmove(formula->arena.data + c->moved_to, c,
+				sizeof(unsigned int) * ClauseWords(c->n_literals));
+	}
+
+	formula->nlearnts = j;
+	formula->arena.size = to;
+}
+
+typedef enum SearchMode
+{
+	SEARCH_DPLL = 1,	/* chronological backtracking over decisions */
+	SEARCH_CDCL = 2,	/* clause learning and non-chronological backjumps */
+	SEARCH_CUBE = 3,	/* lookahead splits formula into cubes for CDCL */
+	SEARCH_PARALLEL_DPLL = 4,	/* DPLL subtrees are stolen by idle threads */
+}		SearchMode;
+
+typedef enum RestartPolicy
+{
+	RESTART_NONE = 0,
+	RESTART_LUBY = 1,		/* intervals follow the Luby sequence */
+	RESTART_GEOMETRIC = 2,	/* each interval is 'factor' times longer */
+	RESTART_GLUCOSE = 3,	/* recent LBDs are worse than long-term ones */
+}		RestartPolicy;
+
+/* Smoothing factors of the glucose-style LBD moving averages */
+#define RESTART_FAST_EMA_ALPHA	(1.0 / 32)
+#define RESTART_SLOW_EMA_ALPHA	(1.0 / 4096)
+
+/*
+ * Decides when the CDCL search should backtrack to level 0. Learned clauses,
+ * activities and saved phases are kept, so the search continues from a
+ * different, hopefully better, decision order.
+ */
+typedef struct RestartScheduler
+{
+	RestartPolicy	policy;
+
+	/*
+	 * Conflicts in the first interval: unit of the Luby sequence, the first
+	 * geometric interval or the minimum interval for glucose policy.
+	 */
+	unsigned int	base;
+	double			factor;	/* growth of geometric intervals */
+	double			margin;	/* how much recent LBDs must be worse (glucose) */
+
+	unsigned long long nrestarts;
+	unsigned long long nconflicts;		/* total */
+	unsigned long long conflicts;		/* since the last restart */
+	double			limit;				/* length of the current interval */
+	double			fast_lbd;
+	double			slow_lbd;
+}		RestartScheduler;
+
+typedef struct SolverOptions
+{
+	SearchMode	mode;
+	DecisionHeuristic heuristic;
+	bool		static_counts;
+	PhasePolicy	phase;
+	bool		phase_saving;
+	unsigned long long seed;
+	RestartPolicy restart;
+	unsigned int restart_base;
+	double		restart_factor;
+	double		restart_margin;
+	bool		verify_model;
+	const char *proof_path;	/* NULL if proof is not needed */
+	ProofFormat	proof_format;
+	int			nsolvers;	/* portfolio size, 1 to solve in this thread */
+	bool		share_clauses;	/* between solvers of the portfolio */
+	int			cube_depth;		/* decisions in each cube */
+}		SolverOptions;
+
+/*
+ * Outcome of the solver. Values are exit codes of the SAT competition.
+ */
+typedef enum SolverResult
+{
+	RESULT_ERROR = 0,
+	RESULT_UNKNOWN = 1,		/* search is interrupted, never an exit code */
+	RESULT_SAT = 10,
+	RESULT_UNSAT = 20,
+}		SolverResult;
+
+/*
+ * Returns i-th element of the Luby sequence: 1 1 2 1 1 2 4 1 1 2 ...
+ */
+static double
+luby(unsigned long long i)
+{
+	unsigned long long size = 1;
+	int			seq = 0;
+
+	/* Find the finite subsequence containing index 'i' and its size */
+	while (size < i + 1)
+	{
+		seq++;
+		size = 2 * size + 1;
+	}
+
+	while (size - 1 != i)
+	{
+		size = (size - 1) / 2;
+		seq--;
+		i = i % size;
+	}
+
+	return ldexp(1.0, seq);
+}
+
+static void
+init_restarts(RestartScheduler *restart, SolverOptions *options)
+{
+	restart->policy = options->restart;
+	restart->base = options->restart_base;
+	restart->factor = options->restart_factor;
+	restart->margin = options->restart_margin;
+	restart->nrestarts = 0;
+	restart->nconflicts = 0;
+	restart->conflicts = 0;
+	restart->limit = (restart->policy == RESTART_LUBY) ?
+		restart->base * luby(0) : restart->base;
+	restart->fast_lbd = 0.0;
+	restart->slow_lbd = 0.0;
+}
+
+static void
+restart_on_conflict(RestartScheduler *restart, unsigned int lbd)
+{
+	double	fast_alpha = RESTART_FAST_EMA_ALPHA;
+	double	slow_alpha = RESTART_SLOW_EMA_ALPHA;
+
+	restart->nconflicts++;
+	restart->conflicts++;
+
+	/* Until enough conflicts seen, averages are plain means */
+	if (fast_alpha < 1.0 / restart->nconflicts)
+		fast_alpha = 1.0 / restart->nconflicts;
+	if (slow_alpha < 1.0 / restart->nconflicts)
+		slow_alpha = 1.0 / restart->nconflicts;
+
+	restart->fast_lbd += fast_alpha * (lbd - restart->fast_lbd);
+	restart->slow_lbd += slow_alpha * (lbd - restart->slow_lbd);
+}
+
+static bool
+restart_is_due(RestartScheduler *restart)
+{
+	switch (restart->policy)
+	{
+		case RESTART_LUBY:
+		case RESTART_GEOMETRIC:
+			return restart->conflicts >= restart->limit;
+		case RESTART_GLUCOSE:
+			return restart->conflicts >= restart->base &&
+				restart->fast_lbd > restart->margin * restart->slow_lbd;
+		default:
+			return false;
+	}
+}
+
+static void
+restart_done(RestartScheduler *restart)
+{
+	restart->nrestarts++;
+	restart->conflicts = 0;
+
+	if (restart->policy == RESTART_LUBY)
+		restart->limit = restart->base * luby(restart->nrestarts);
+	else if (restart->policy == RESTART_GEOMETRIC)
+		restart->limit *= restart->factor;
+}
+
+/*
+ * Model may have millions of variables, so it is formatted into a large
+ * buffer, which is written directly to the standard output.
+ */
+#define OUTPUT_BUFFER_SIZE	(1 << 20)
+
+/* Values are wrapped into "v" lines of about this width */
+#define MODEL_LINE_WIDTH	78
+
+typedef struct OutputWriter
+{
+	char	   *buf;
+	size_t		len;
+	bool		ok;		/* no write has failed */
+}		OutputWriter;
+
+static void
+output_flush(OutputWriter *out)
+{
+	if (out->ok && !write_block(STDOUT_FILENO, out->buf, out->len))
+		out->ok = false;
+
+	out->len = 0;
+}
+
+static void
+output_put(OutputWriter *out, const char *str, size_t len)
+{
+	if (out->len + len > OUTPUT_BUFFER_SIZE)
+		output_flush(out);
+
+	memcpy(out->buf + out->len, str, len);
+	out->len += len;
+}
+
+/*
+ * Put ' ' followed by decimal representation of 'val'. Returns number of
+ * characters put.
+ */
+static size_t
+output_put_value(OutputWriter *out, int val)
+{
+	char	digits[24];
+	char   *p = format_decimal(digits + sizeof(digits), val);
+
+	*--p = ' ';
+
+	output_put(out, p, digits + sizeof(digits) - p);
+
+	return digits + sizeof(digits) - p;
+}
+
+/*
+ * Print "s SATISFIABLE" and the model in "v" lines terminated by 0, as the
+ * SAT competition expects.
+ *
+ * Returns false iff the model cannot be printed. Error is reported.
+ */
+static bool
+print_model(Formula *formula)
+{
+	OutputWriter out = {NULL, 0, true};
+	size_t		width = 1;
+
+	if ((out.buf = (char *) malloc(OUTPUT_BUFFER_SIZE)) == NULL)
+	{
+		ereport("Cannot allocate memory for model output");
+		return false;
+	}
+
+	/* Anything printed before must precede the model */
+	fflush(stdout);
+
+	output_put(&out, "s SATISFIABLE\nv", strlen("s SATISFIABLE\nv"));
+	for (int i = 0; i < formula->nvariables; i++)
+	{
+		Variable *v = &formula->variables[i];
+
+		if (width >= MODEL_LINE_WIDTH)
+		{
+			output_put(&out, "\nv", strlen("\nv"));
+			width = 1;
+		}
+
+		/* Variables, that are not assigned, may have any value */
+		width += output_put_value(&out, (v->assigned_value == VAL_FALSE) ?
+								  -(int) v->name : (int) v->name);
+	}
+	output_put(&out, " 0\n", strlen(" 0\n"));
+	output_flush(&out);
+
+	free(out.buf);
+
+	if (!out.ok)
+		ereport("Cannot write model");
+
+	return out.ok;
+}
+
+/*
+ * Check that every clause of the formula has a true literal. Learned clauses
+ * are not checked, they follow from the formula. Clauses of the formula only
+ * lost duplicate literals when they were attached, so the input is checked.
+ */
+static bool
+verify_model(Formula *formula)
+{
+	for (int i = 0; i < formula->nclauses; i++)
+	{
+		Clause *c = ClauseAt(formula, formula->clauses[i]);
+		bool	satisfied = false;
+
+		for (int j = 0; j < c->n_literals && !satisfied; j++)
+			satisfied = LiteralGivesTrue(formula, c->literals[j]);
+
+		if (!satisfied)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Cube-and-conquer: lookahead splits the formula into cubes - conjunctions of
+ * literals, which cover the whole search space. Solvers take cubes from the
+ * queue one by one and search for a model extending the cube. Formula is
+ * unsatisfiable iff all cubes are refuted.
+ */
+struct CubeQueue
+{
+	Literal	   *literals;	/* cubes one after another */
+	size_t		nliterals;
+	size_t		literals_capacity;
+
+	/* Cube i is literals[offsets[i]] ... literals[offsets[i + 1] - 1] */
+	size_t	   *offsets;
+	int			ncubes;
+	int			cubes_capacity;
+
+	atomic_int	next;		/* first cube, that is not taken by solvers */
+	atomic_int	nrefuted;	/* cubes refuted by solvers */
+};
+
+/* Variables tried by lookahead at each node, the most frequent ones */
+#define LOOKAHEAD_CANDIDATES	16
+
+/*
+ * Take the next cube. Returns number of its literals, or -1 if the queue is
+ * empty.
+ */
+static int
+next_cube(CubeQueue *queue, const Literal **cube)
+{
+	int		i = atomic_fetch_add_explicit(&queue->next, 1,
+										  memory_order_relaxed);
+
+	if (i >= queue->ncubes)
+		return -1;
+
+	*cube = &queue->literals[queue->offsets[i]];
+	return (int) (queue->offsets[i + 1] - queue->offsets[i]);
+}
+
+/*
+ * Take the next cube or guiding path to search below. Returns number of its
+ * literals, or -1 if there is none.
+ */
+static int
+take_cube(Formula *formula, const Literal **cube)
+{
+	if (formula->work != NULL)
+		return steal_guiding_path(formula, cube);
+
+	return next_cube(formula->cubes, cube);
+}
+
+/*
+ * Current cube is refuted, so count it and take the next one. Returns false
+ * iff there is none.
+ */
+static bool
+switch_cube(Formula *formula, AssignmentStack *stack, const Literal **cube,
+			int *ncube)
+{
+	if (formula->cubes != NULL)
+		atomic_fetch_add_explicit(&formula->cubes->nrefuted, 1,
+								  memory_order_relaxed);
+
+	backtrack(formula, stack, 0);
+	return (*ncube = take_cube(formula, cube)) >= 0;
+}
+
+/*
+ * Add decisions of the stack as a cube. Returns false iff memory cannot be
+ * allocated.
+ */
+static bool
+add_cube(CubeQueue *queue, AssignmentStack *stack)
+{
+	unsigned int nlevels = decision_level(stack);
+
+	if (queue->nliterals + nlevels > queue->literals_capacity)
+	{
+		Literal *literals;
+		size_t	capacity = queue->literals_capacity * 2 + nlevels;
+
+		if ((literals = (Literal *) realloc(queue->literals,
+											sizeof(Literal) * capacity)) == NULL)
+			return false;
+
+		queue->literals = literals;
+		queue->literals_capacity = capacity;
+	}
+
+	if (queue->ncubes + 1 >= queue->cubes_capacity)
+	{
+		size_t *offsets;
+		int		capacity = queue->cubes_capacity * 2 + 2;
+
+		if ((offsets = (size_t *) realloc(queue->offsets,
+										  sizeof(size_t) * capacity)) == NULL)
+			return false;
+
+		queue->offsets = offsets;
+		queue->offsets[0] = 0;
+		queue->cubes_capacity = capacity;
+	}
+
+	for (unsigned int i = 0; i < nlevels; i++)
+	{
+		Assignment *a = &stack->data[stack->level_start[i]];
+
+		queue->literals[queue->nliterals++] =
+			MakeLiteral(a->literal_name - 1, a->newval == VAL_FALSE);
+	}
+
+	queue->offsets[++queue->ncubes] = queue->nliterals;
+	return true;
+}
+
+/*
+ * Decide the literal at a new level and propagate it. 'nimplied' is set to
+ * the number of assignments it makes.
+ *
+ * Returns false iff propagation runs into a conflict. The new level is left
+ * on the stack in any case.
+ */
+static bool
+assume_literal(Formula *formula, AssignmentStack *stack, Literal l,
+			   unsigned int *nimplied)
+{
+	unsigned int depth = stack->depth;
+	Assignment	a = {
+		.type = VAL_PROPAGATION,
+		.newval = !LiteralIsNegated(l),
+		.literal_name = LiteralVarIdx(l) + 1,
+	};
+	ClauseRef	conflict;
+
+	new_decision_level(stack);
+	enqueue_assignment(formula, stack, &a, InvalidClauseRef);
+	conflict = unit_propagate(formula, stack);
+
+	*nimplied = stack->depth - depth;
+	return conflict == InvalidClauseRef;
+}
+
+/*
+ * Split the search space below the current decisions up to 'depth' more
+ * levels. Each candidate variable is assigned both values in turn, and the
+ * one implying most assignments on both sides is chosen for the split. Failed
+ * literal is chosen at once, since one of the branches is refuted.
+ *
+ * Returns false iff memory cannot be allocated.
+ */
+static bool
+split_into_cubes(Formula *formula, AssignmentStack *stack, CubeQueue *queue,
+				 const unsigned int *by_occurrences, int depth)
+{
+	unsigned int level = decision_level(stack);
+	Literal		branch = 0;
+	double		best_score = -1.0;
+	int			ncandidates = 0;
+
+	if (depth == 0)
+		return add_cube(queue, stack);
+
+	for (int i = 0; i < formula->nvariables &&
+		 ncandidates < LOOKAHEAD_CANDIDATES; i++)
+	{
+		unsigned int var_idx = by_occurrences[i];
+		unsigned int npositive, nnegative;
+		bool		positive_ok, negative_ok;
+		double		score;
+
+		if (formula->variables[var_idx].assigned_value != VAL_UNASSIGNED)
+			continue;
+
+		ncandidates++;
+
+		positive_ok = assume_literal(formula, stack,
+									 MakeLiteral(var_idx, false), &npositive);
+		backtrack(formula, stack, level);
+		negative_ok = assume_literal(formula, stack,
+									 MakeLiteral(var_idx, true), &nnegative);
+		backtrack(formula, stack, level);
+
+		if (!positive_ok || !negative_ok)
+		{
+			branch = MakeLiteral(var_idx, false);
+			break;
+		}
+
+		score = (double) npositive * nnegative;
+		if (score > best_score)
+		{
+			best_score = score;
+			branch = MakeLiteral(var_idx, npositive < nnegative);
+		}
+	}
+
+	/* All variables are assigned, the cube gives a model */
+	if (ncandidates == 0)
+		return add_cube(queue, stack);
+
+	/* Branches refuted by propagation produce no cubes */
+	for (int i = 0; i < 2; i++)
+	{
+		Literal		l = (i == 0) ? branch : branch ^ 1;
+		unsigned int nimplied;
+		bool		ok = true;
+
+		if (assume_literal(formula, stack, l, &nimplied))
+			ok = split_into_cubes(formula, stack, queue, by_occurrences,
+								  depth - 1);
+		backtrack(formula, stack, level);
+
+		if (!ok)
+			return false;
+	}
+
+	return true;
+}
+
+typedef struct VariableOccurrences
+{
+	int				noccurrences;
+	unsigned int	var_idx;
+}		VariableOccurrences;
+
+static int
+compare_by_occurrences(const void *a, const void *b)
+{
+	int		occ_a = ((const VariableOccurrences *) a)->noccurrences;
+	int		occ_b = ((const VariableOccurrences *) b)->noccurrences;
+
+	return (occ_a < occ_b) - (occ_a > occ_b);
+}
+
+/*
+ * Fill the queue with cubes of 'depth' decisions at most. Formula is left
+ * without assignments.
+ *
+ * Returns false iff memory cannot be allocated.
+ */
+static bool
+build_cubes(Formula *formula, CubeQueue *queue, int depth)
+{
+	unsigned int *by_occurrences;
+	VariableOccurrences *occurrences;
+	bool		ok = true;
+	AssignmentStack stack = {
+		.depth = 0,
+		.data = NULL,
+		.qhead = 0,
+		.level_start = NULL,
+		.nlevels = 0,
+	};
+
+	stack.data = (Assignment *)
+		malloc(sizeof(Assignment) * ((size_t) formula->nvariables + 1));
+	stack.level_start = (unsigned int *)
+		malloc(sizeof(unsigned int) * ((size_t) formula->nvariables + 1));
+	by_occurrences = (unsigned int *)
+		malloc(sizeof(unsigned int) * formula->nvariables);
+	occurrences = (VariableOccurrences *)
+		calloc(formula->nvariables, sizeof(VariableOccurrences));
+
+	if (stack.data == NULL || stack.level_start == NULL ||
+		by_occurrences == NULL || occurrences == NULL)
+	{
+		ok = false;
+		goto exit;
+	}
+
+	for (int i = 0; i < formula->nclauses; i++)
+	{
+		Clause *c = ClauseAt(formula, formula->clauses[i]);
+
+		for (int j = 0; j < c->n_literals; j++)
+			occurrences[LiteralVarIdx(c->literals[j])].noccurrences++;
+	}
+
+	for (int i = 0; i < formula->nvariables; i++)
+		occurrences[i].var_idx = i;
+
+	qsort(occurrences, formula->nvariables, sizeof(VariableOccurrences),
+		  compare_by_occurrences);
+
+	for (int i = 0; i < formula->nvariables; i++)
+		by_occurrences[i] = occurrences[i].var_idx;
+
+	/* Unsatisfiable formula has no cubes */
+	if (propagate_unit_clauses(formula, &stack) == InvalidClauseRef &&
+		unit_propagate(formula, &stack) == InvalidClauseRef)
+		ok = split_into_cubes(formula, &stack, queue, by_occurrences, depth);
+
+	/* Level 0 is propagated again by the solvers */
+	backtrack(formula, &stack, 0);
+	while (stack.depth > 0)
+		revert_change(formula, stack.data[--stack.depth]);
+
+exit:
+	free(stack.data);
+	free(stack.level_start);
+	free(by_occurrences);
+	free(occurrences);
+
+	return ok;
+}
+
+/*
+ * Search for a model of the formula. Values of variables are left in the
+ * formula, when it is found.
+ *
+ * With cubes, the search goes through cubes taken from the queue, until a
+ * model is found or the queue is empty. Learned clauses follow from the
+ * formula only, so they are kept from one cube to another. Guiding paths
+ * stolen from other threads are searched the same way.
+ *
+ * Returns RESULT_UNKNOWN, if the search is interrupted or cubes are over.
+ */
+static SolverResult
+solve(Formula *formula, SolverOptions *options)
+{
+	unsigned int nvariables = formula->nvariables;
+	SolverResult result = RESULT_UNSAT;
+	ClauseRef conflict;
+	RestartScheduler restart;
+	unsigned long long next_reduce = REDUCE_FIRST_INTERVAL;
+	unsigned long long reduce_interval = REDUCE_FIRST_INTERVAL;
+	bool		by_cubes = (formula->cubes != NULL || formula->work != NULL);
+	const Literal *cube = NULL;
+	int			ncube = 0;
+	AssignmentStack stack = {
+		.depth = 0,
+		.data = NULL,
+		.qhead = 0,
+		.level_start = NULL,
+		.nlevels = 0,
+	};
+
+	if ((stack.data = (Assignment *)
+			malloc(sizeof(Assignment) * ((size_t) nvariables + 1))) == NULL ||
+		(stack.level_start = (unsigned int *)
+			malloc(sizeof(unsigned int) * ((size_t) nvariables + 1))) == NULL)
+	{
+		free(stack.data);
+		ereport_and_exit("Cannot allocate memory for assignment stack", RESULT_ERROR);
+	}
+
+	if (!init_decision_heuristic(formula, options->heuristic,
+								 options->static_counts))
+	{
+		free(stack.data);
+		free(stack.level_start);
+		ereport_and_exit("Cannot allocate memory for decision heuristic", RESULT_ERROR);
+	}
+
+	if (!init_phases(formula, options->phase, options->phase_saving,
+					 options->seed))
+	{
+		free(stack.data);
+		free(stack.level_start);
+		ereport_and_exit("Cannot allocate memory for phases", RESULT_ERROR);
+	}
+
+	if (options->proof_path != NULL &&
+		(formula->proof = proof_open(options->proof_path,
+									 options->proof_format,
+									 formula->nclauses)) == NULL)
+	{
+		free(stack.data);
+		free(stack.level_start);
+		return RESULT_ERROR; /* Error message already emited */
+	}
+
+	init_restarts(&restart, options);
+	formula->clause_activity_inc = 1.0;
+
+	if ((conflict = propagate_unit_clauses(formula, &stack)) != InvalidClauseRef)
+	{
+		proof_add_empty_clause(formula, &stack, conflict);
+		goto exit;
+	}
+
+	if (by_cubes && (ncube = take_cube(formula, &cube)) < 0)
+	{
+		result = RESULT_UNKNOWN;
+		goto exit;
+	}
+
+	while (true)
+	{
+		Assignment a;
+		AssignedValue value;
+
+		/* Another solver of the portfolio may have already answered */
+		if (formula->interrupt != NULL &&
+			atomic_load_explicit(formula->interrupt, memory_order_relaxed))
+		{
+			result = RESULT_UNKNOWN;
+			break;
+		}
+
+		conflict = unit_propagate(formula, &stack);
+
+		if (conflict != InvalidClauseRef)
+		{
+			formula->nconflicts++;
+
+			if (options->mode == SEARCH_CDCL && decision_level(&stack) > 0)
+			{
+				restart_on_conflict(&restart,
+									learn_from_conflict(formula, &stack,
+														conflict));
+				continue;
+			}
+
+			if (options->mode == SEARCH_DPLL)
+			{
+				Clause *c = ClauseAt(formula, conflict);
+
+				/* There is no analysis, so conflicting clause is blamed */
+				for (int i = 0; i < c->n_literals; i++)
+					bump_variable_activity(formula,
+										   LiteralVariable(formula,
+														   c->literals[i]));
+				decay_variable_activities(formula);
+
+				if (flip_last_decision(formula, &stack))
+					continue;
+			}
+
+			/* Conflict above level 0 refutes only the cube */
+			if (by_cubes && decision_level(&stack) > 0)
+			{
+				if (switch_cube(formula, &stack, &cube, &ncube))
+					continue;
+
+				result = RESULT_UNKNOWN;
+				break;
+			}
+
+			proof_add_empty_clause(formula, &stack, conflict);
+			break;
+		}
+
+		/* DPLL cannot restart without losing track of the explored branches */
+		if (options->mode == SEARCH_CDCL && restart_is_due(&restart))
+		{
+			backtrack(formula, &stack, 0);
+			restart_done(&restart);
+		}
+
+		/* Clauses of other solvers are added at level 0 after propagation */
+		if (options->mode == SEARCH_CDCL && formula->exchange != NULL &&
+			decision_level(&stack) == 0)
+		{
+			unsigned int depth = stack.depth;
+
+			if (!import_shared_clauses(formula, &stack))
+				break;
+
+			/* Imported units are propagated first */
+			if (stack.depth > depth)
+				continue;
+		}
+
+		if (options->mode == SEARCH_CDCL && restart.nconflicts >= next_reduce)
+		{
+			reduce_learnt_clauses(formula);
+			reduce_interval += REDUCE_INTERVAL_INCREMENT;
+			next_reduce = restart.nconflicts + reduce_interval;
+		}
+
+		/* Literals of the cube are decided before any others */
+		if (by_cubes && decision_level(&stack) < (unsigned int) ncube)
+		{
+			Literal		l = cube[decision_level(&stack)];
+
+			if (LiteralGivesFalse(formula, l))
+			{
+				if (switch_cube(formula, &stack, &cube, &ncube))
+					continue;
+
+				result = RESULT_UNKNOWN;
+				break;
+			}
+
+			/* Level of a literal, that is already true, stays empty */
+			new_decision_level(&stack);
+			if (LiteralIsUnassigned(formula, l))
+			{
+				a.literal_name = LiteralVarIdx(l) + 1;
+				a.newval = !LiteralIsNegated(l);
+				a.type = PATH_PROPAGATION;
+				enqueue_assignment(formula, &stack, &a, InvalidClauseRef);
+			}
+			continue;
+		}
+
+		a.literal_name = find_unassigned_literal(formula, &value);
+		if (a.literal_name == InvalidLiteralName)
+		{
+			result = RESULT_SAT;
+			break;
+		}
+
+		a.newval = value;
+		a.type = VAL_PROPAGATION;
+		new_decision_level(&stack);
+		enqueue_assignment(formula, &stack, &a, InvalidClauseRef);
+		formula->ndecisions++;
+
+		if (formula->work != NULL)
+			publish_decision(formula->work, &stack);
+	}
+
+exit:
+	if (formula->proof != NULL && !proof_close(formula->proof))
+		result = RESULT_ERROR;
+	formula->proof = NULL;
+
+	free(stack.data);
+	free(stack.level_start);
+
+	return result;
+}
+
+/*
+ * Print the result in the format of the SAT competition. Returns the result
+ * to exit with.
+ */
+static SolverResult
+report_result(Formula *formula, SolverResult result, SolverOptions *options)
+{
+	if (result == RESULT_UNSAT)
+		printf("s UNSATISFIABLE\n");
+	else if (result == RESULT_SAT)
+	{
+		if (options->verify_model && !verify_model(formula))
+		{
+			errno = 0;
+			ereport("Internal error: model does not satisfy the formula");
+			return RESULT_ERROR;
+		}
+
+		if (!print_model(formula))
+			return RESULT_ERROR;
+	}
+
+	return result;
+}
+
+/*
+ * Configurations of the portfolio solvers after the first one, which uses
+ * options as they are given. They are reused with different seeds, if there
+ * are more solvers.
+ */
+static const struct
+{
+	DecisionHeuristic heuristic;
+	bool		static_counts;
+	PhasePolicy	phase;
+	bool		phase_saving;
+	RestartPolicy restart;
+}			portfolio_configs[] = {
+	{HEURISTIC_VSIDS, false, PHASE_FALSE, true, RESTART_GLUCOSE},
+	{HEURISTIC_VSIDS, false, PHASE_TRUE, true, RESTART_LUBY},
+	{HEURISTIC_VSIDS, false, PHASE_RANDOM, true, RESTART_GEOMETRIC},
+	{HEURISTIC_JW, true, PHASE_DEFAULT, true, RESTART_LUBY},
+	{HEURISTIC_VSIDS, false, PHASE_OCCURRENCE, false, RESTART_GLUCOSE},
+	{HEURISTIC_MOMS, true, PHASE_DEFAULT, true, RESTART_GLUCOSE},
+	{HEURISTIC_VSIDS, false, PHASE_RANDOM, false, RESTART_LUBY},
+	{HEURISTIC_DLIS, true, PHASE_OCCURRENCE, true, RESTART_GEOMETRIC},
+};
+
+#define NPORTFOLIO_CONFIGS \
+	((int) (sizeof(portfolio_configs) / sizeof(portfolio_configs[0])))
+
+typedef struct Portfolio
+{
+	atomic_bool	stop;		/* set by the first solver, that answers */
+	atomic_int	winner;		/* its index, -1 until then */
+	atomic_int	nbusy;		/* solvers with DPLL subtrees, if they steal them */
+}		Portfolio;
+
+typedef struct PortfolioSolver
+{
+	Portfolio  *portfolio;
+	int			idx;
+	Formula	   *formula;
+	SolverOptions options;
+	ClauseExchange exchange;
+	WorkSharing work;
+	SolverResult result;
+	pthread_t	thread;
+}		PortfolioSolver;
+
+static void *
+portfolio_solver_main(void *arg)
+{
+	PortfolioSolver *solver = (PortfolioSolver *) arg;
+	int			nobody = -1;
+
+	solver->result = solve(solver->formula, &solver->options);
+
+	if ((solver->result == RESULT_SAT || solver->result == RESULT_UNSAT) &&
+		atomic_compare_exchange_strong(&solver->portfolio->winner, &nobody,
+									   solver->idx))
+		atomic_store(&solver->portfolio->stop, true);
+
+	/* Subtrees of the failed solver would never be explored */
+	if (solver->result == RESULT_ERROR && solver->formula->work != NULL)
+		atomic_store(&solver->portfolio->stop, true);
+
+	return NULL;
+}
+
+/*
+ * Run 'nsolvers' differently configured solvers on copies of the formula in
+ * separate threads. The first answer is reported and the other solvers are
+ * interrupted.
+ *
+ * With cubes, all solvers are configured alike and conquer cubes of the
+ * queue. Formula is unsatisfiable, if they refute all of them. In parallel
+ * DPLL mode solvers steal subtrees of the search from each other, and the
+ * formula is unsatisfiable, once all of them are explored.
+ */
+static SolverResult
+solve_portfolio(Formula *formula, SolverOptions *options, int nsolvers,
+				CubeQueue *cubes)
+{
+	Portfolio	portfolio;
+	PortfolioSolver *solvers;
+	ClauseRing *rings = NULL;
+	WorkDeque  *deques = NULL;
+	bool		stealing = (options->mode == SEARCH_PARALLEL_DPLL);
+	SolverResult result = RESULT_ERROR;
+	int			nstarted = 0;
+	int			winner;
+
+	if ((solvers = (PortfolioSolver *)
+			calloc(nsolvers, sizeof(PortfolioSolver))) == NULL)
+		ereport_and_exit("Cannot allocate memory for portfolio", RESULT_ERROR);
+
+	if (stealing &&
+		(deques = (WorkDeque *) calloc(nsolvers, sizeof(WorkDeque))) == NULL)
+	{
+		free(solvers);
+		ereport_and_exit("Cannot allocate memory for work stealing", RESULT_ERROR);
+	}
+
+	/* Portfolio works without sharing, if there is no memory for it */
+	if (options->share_clauses && !stealing &&
+		(rings = (ClauseRing *) calloc(nsolvers, sizeof(ClauseRing))) == NULL)
+		fprintf(stderr, "Warning: cannot allocate memory for clause sharing\n");
+
+	atomic_init(&portfolio.stop, false);
+	atomic_init(&portfolio.winner, -1);
+	atomic_init(&portfolio.nbusy, 1);	/* the first solver starts at the root */
 
-	for (int i = 0; i < v->nrelated_clauses; i++)
+	/* Copies are made before any solver starts changing the formula */
+	for (int i = 0; i < nsolvers; i++)
 	{
-		Clause *c = v->related_clauses[i];
-		for (int j = 0; j < c->n_literals; j++)
+		PortfolioSolver *solver = &solvers[i];
+
+		solver->portfolio = &portfolio;
+		solver->idx = i;
+		solver->options = *options;
+
+		if (cubes != NULL || stealing)
+		{
+			solver->options.mode = stealing ? SEARCH_DPLL : SEARCH_CDCL;
+			solver->options.seed = options->seed + i;
+		}
+		else if (i > 0)
 		{
-			Literal *l = &c->literals[j];
+			int config = (i - 1) % NPORTFOLIO_CONFIGS;
+
+			solver->options.mode = SEARCH_CDCL;
+			solver->options.heuristic = portfolio_configs[config].heuristic;
+			solver->options.static_counts =
+				portfolio_configs[config].static_counts;
+			solver->options.phase = portfolio_configs[config].phase;
+			solver->options.phase_saving =
+				portfolio_configs[config].phase_saving;
+			solver->options.restart = portfolio_configs[config].restart;
+			solver->options.seed = options->seed + i;
+		}
 
-			if (l->stack_depth != a.stack_depth)
-				continue;
+		if ((solver->formula = (i == 0) ? formula : clone_formula(formula)) == NULL)
+		{
+			fprintf(stderr, "Warning: only %d solvers fit into memory\n", i);
+			nsolvers = i;
+			break;
+		}
 
-			if (!LiteralIsInUse(l))
-			{
-				LiteralSetUsed(l);
-				c->n_in_use += 1;
-			}
+		solver->formula->interrupt = &portfolio.stop;
+		solver->formula->cubes = cubes;
 
-			if (l->variable->name == a.literal_name)
-				l->variable->assigned_value = a.oldval;
+		if (rings != NULL &&
+			(solver->exchange.tails = (unsigned long long *)
+				calloc(nsolvers, sizeof(unsigned long long))) != NULL)
+		{
+			solver->exchange.rings = rings;
+			solver->exchange.nrings = nsolvers;
+			solver->exchange.self = i;
+			solver->exchange.lbd_limit = SHARE_INITIAL_LBD;
+			solver->formula->exchange = &solver->exchange;
+		}
+	}
+
+	for (int i = 0; i < nsolvers && stealing; i++)
+	{
+		WorkSharing *work = &solvers[i].work;
+
+		work->deques = deques;
+		work->ndeques = nsolvers;
+		work->self = i;
+		work->nbusy = &portfolio.nbusy;
+		work->busy = work->root = (i == 0);
+		solvers[i].formula->work = work;
+	}
+
+	for (; nstarted < nsolvers; nstarted++)
+	{
+		if (pthread_create(&solvers[nstarted].thread, NULL,
+						   portfolio_solver_main, &solvers[nstarted]) != 0)
+		{
+			fprintf(stderr, "Warning: only %d solver threads are started\n",
+					nstarted);
+			break;
 		}
 	}
+
+	/* Without any thread the first solver runs here */
+	if (nstarted == 0)
+	{
+		portfolio_solver_main(&solvers[0]);
+		nstarted = 1;
+	}
+	else
+	{
+		for (int i = 0; i < nstarted; i++)
+			pthread_join(solvers[i].thread, NULL);
+	}
+
+	if ((winner = atomic_load(&portfolio.winner)) >= 0)
+		result = report_result(solvers[winner].formula, solvers[winner].result,
+							   options);
+	else if (cubes != NULL &&
+			 atomic_load(&cubes->nrefuted) == cubes->ncubes)
+		result = report_result(formula, RESULT_UNSAT, options);
+	else if (stealing && !atomic_load(&portfolio.stop) &&
+			 atomic_load(&portfolio.nbusy) == 0)
+		result = report_result(formula, RESULT_UNSAT, options);
+
+	/* The first formula belongs to the caller */
+	for (int i = 1; i < nsolvers; i++)
+		drop_formula(solvers[i].formula);
+	formula->interrupt = NULL;
+	formula->exchange = NULL;
+	formula->cubes = NULL;
+	formula->work = NULL;
+
+	for (int i = 0; i < nsolvers; i++)
+		free(solvers[i].exchange.tails);
+	free(solvers);
+	free(rings);
+	free(deques);
+
+	return result;
 }
 
-static void
-delete_clause_from_formula(Formula *formula, Clause *clause,
-						   unsigned int stack_depth)
+/*
+ * Split the formula into cubes and conquer them by 'nsolvers' threads.
+ */
+static SolverResult
+solve_cubes(Formula *formula, SolverOptions *options)
 {
-	for (int i = 0; i < clause->n_literals; i++)
+	CubeQueue	cubes = {
+		.literals = NULL,
+		.nliterals = 0,
+		.literals_capacity = 0,
+		.offsets = NULL,
+		.ncubes = 0,
+		.cubes_capacity = 0,
+	};
+	SolverResult result;
+
+	atomic_init(&cubes.next, 0);
+	atomic_init(&cubes.nrefuted, 0);
+
+	if (!build_cubes(formula, &cubes, options->cube_depth))
 	{
-		if (LiteralIsInUse(&clause->literals[i]))
-			LiteralSetUnused(&clause->literals[i], stack_depth);
+		free(cubes.literals);
+		free(cubes.offsets);
+		ereport_and_exit("Cannot allocate memory for cubes", RESULT_ERROR);
 	}
 
-	clause->n_in_use = 0;
+	/* Lookahead may refute all branches by itself */
+	if (cubes.ncubes == 0)
+		result = report_result(formula, RESULT_UNSAT, options);
+	else
+		result = solve_portfolio(formula, options, options->nsolvers, &cubes);
+
+	free(cubes.literals);
+	free(cubes.offsets);
+
+	return result;
 }
 
-static bool
-clause_gives_false(Clause *cl)
+/*
+ * Load the formula, solve it and print the result.
+ */
+static SolverResult
+dpll(DimacsReader *reader, int nclauses, int nvariables, SolverOptions *options)
 {
-	bool	all_unused = true;
+	Formula		*formula;
+	SolverResult result;
 
-	for (int i = 0; i < cl->n_literals; i++)
-	{
-		if (!LiteralIsInUse(&cl->literals[i]))
-			continue;
+	if ((formula = create_formula(reader, nclauses, nvariables)) == NULL)
+		return RESULT_ERROR; /* Error message already emited */
+
+	if (options->mode == SEARCH_CUBE)
+		result = solve_cubes(formula, options);
+	else if (options->nsolvers > 1 || options->mode == SEARCH_PARALLEL_DPLL)
+		result = solve_portfolio(formula, options, options->nsolvers, NULL);
+	else
+		result = report_result(formula, solve(formula, options), options);
 
-		all_unused = false;
+	drop_formula(formula);
 
-		if (cl->literals[i].variable->assigned_value == VAL_UNASSIGNED)
-			return false;
+	return result;
+}
 
-		if (LiteralGivesTrue(&cl->literals[i]))
-			return false;
-	}
+static double
+seconds_since(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	return all_unused ? false : true;
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
 }
 
-static bool propagate_literal_value(Formula *formula, Assignment a);
+/*
+ * Load the formula without solving it and report the parser throughput.
+ * 'start' is the moment the file was opened.
+ */
+static int
+benchmark_parse(DimacsReader *reader, int nclauses, int nvariables,
+				struct timespec *start)
+{
+	Formula	*formula;
+	double	elapsed;
+	double	megabytes;
+
+	if ((formula = create_formula(reader, nclauses, nvariables)) == NULL)
+		return 0; /* Error message already emited */
+
+	elapsed = seconds_since(start);
+	megabytes = reader->nbytes / (1024.0 * 1024.0);
+
+	printf("Parsed %d variables, %d clauses, %.1f MB in %.3f s (%.1f MB/s)\n",
+		   formula->nvariables, formula->nclauses, megabytes, elapsed,
+		   elapsed > 0 ? megabytes / elapsed : 0.0);
+
+	drop_formula(formula);
+
+	return 1;
+}
 
 /*
- * Returns false iff we found the polar pair.
+ * Batch mode solves many formulas by a pool of threads, each formula by a
+ * single thread. A line is written for each formula as soon as it is solved.
  */
-static bool
-unit_propagate(Formula *formula, AssignmentStack *stack)
+typedef struct Batch
 {
-	unsigned int target_literal_name;
-	bool	value_to_assign;
-	Assignment a;
+	char	  **paths;
+	int			npaths;
+	atomic_int	next;		/* first formula, that is not taken by workers */
+	SolverOptions *options;
 
-retry:
-	target_literal_name = InvalidLiteralName;
+	int			out_fd;
+	pthread_mutex_t out_lock;	/* lines are written whole */
+	bool		out_failed;
+}		Batch;
 
-	/* Try to find clause, that contains only single literal */
-	for (int i = 0; i < formula->nclauses; i++)
-	{
-		Clause *unit_clause = &formula->clauses[i];
+typedef struct BatchWorker
+{
+	Batch	   *batch;
+	ReaderBuffers buffers;	/* kept from formula to formula */
+	char	   *line;
+	size_t		line_size;
+	pthread_t	thread;
+}		BatchWorker;
 
-		if (unit_clause->n_in_use != 1)
-			continue;
+/*
+ * Path of the formula is the last field of its line, so it may contain
+ * spaces. Errors are reported to stderr and leave the results intact.
+ */
+#define BATCH_HEADER \
+	"c result seconds variables clauses decisions conflicts propagations " \
+	"instance\n"
 
-		/* Found one */
+/*
+ * Solve the formula and put the line describing it into the line buffer.
+ * Returns false iff memory cannot be allocated.
+ */
+static bool
+solve_batch_formula(BatchWorker *worker, const char *path)
+{
+	SolverOptions *options = worker->batch->options;
+	DimacsReader reader;
+	Formula    *formula = NULL;
+	SolverResult result = RESULT_ERROR;
+	struct timespec start;
+	int			nvariables;
+	int			nclauses;
+	size_t		size = strlen(path) + 256;
+	const char *status;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (reader_open(&reader, path, &worker->buffers))
+	{
+		/* Threads of the pool are busy with other formulas */
+		reader.parse_threads = 1;
 
-		/* Find exact literal and creaete value for it */
-		for (int j = 0; j < unit_clause->n_literals; j++)
+		if (read_header(&reader, &nvariables, &nclauses) &&
+			(formula = create_formula(&reader, nclauses, nvariables)) != NULL)
 		{
-			Literal	*literal = &unit_clause->literals[j];
-
-			if (!LiteralIsInUse(literal))
-				continue;
+			result = solve(formula, options);
 
-			target_literal_name = literal->variable->name;
-			value_to_assign = !(literal->is_negated);
-			break;
+			if (result == RESULT_SAT && options->verify_model &&
+				!verify_model(formula))
+			{
+				errno = 0;
+				ereport("Internal error: model does not satisfy the formula");
+				result = RESULT_ERROR;
+			}
 		}
 
-		if (target_literal_name != InvalidLiteralName)
-			break;
+		reader_close(&reader);
 	}
 
-	if (target_literal_name == InvalidLiteralName)
-		return true;
+	switch (result)
+	{
+		case RESULT_SAT:
+			status = "SATISFIABLE";
+			break;
+		case RESULT_UNSAT:
+			status = "UNSATISFIABLE";
+			break;
+		case RESULT_UNKNOWN:
+			status = "UNKNOWN";
+			break;
+		default:
+			status = "ERROR";
+			break;
+	}
 
-	a.type = UNIT_PROPAGATION;
-	a.oldval = VAL_UNASSIGNED;
-	a.newval = value_to_assign;
-	a.literal_name = target_literal_name;
-	push(stack, &a);
+	if (size > worker->line_size)
+	{
+		char   *line;
 
-	if (!propagate_literal_value(formula, a))
-		return false;
+		if ((line = (char *) realloc(worker->line, size)) == NULL)
+		{
+			drop_formula(formula);
+			return false;
+		}
+		worker->line = line;
+		worker->line_size = size;
+	}
 
-	goto retry;
+	snprintf(worker->line, worker->line_size, "%s %.3f %d %d %llu %llu %llu %s\n",
+			 status, seconds_since(&start),
+			 (formula != NULL) ? formula->nvariables : 0,
+			 (formula != NULL) ? formula->nclauses : 0,
+			 (formula != NULL) ? formula->ndecisions : 0,
+			 (formula != NULL) ? formula->nconflicts : 0,
+			 (formula != NULL) ? formula->npropagations : 0, path);
 
-	/* Keep compiler quiet */
+	drop_formula(formula);
 	return true;
 }
 
-static unsigned int
-find_unassigned_literal(Formula *formula)
+static void *
+batch_worker_main(void *arg)
 {
-	unsigned int lname = InvalidLiteralName;
+	BatchWorker *worker = (BatchWorker *) arg;
+	Batch	   *batch = worker->batch;
+	int			i;
 
-	for (int i = 0; i < formula->nvariables; i++)
+	while ((i = atomic_fetch_add(&batch->next, 1)) < batch->npaths)
 	{
-		if (formula->variables[i].assigned_value == VAL_UNASSIGNED)
-		{
-			lname = formula->variables[i].name;
-			break;
-		}
+		bool	ok = solve_batch_formula(worker, batch->paths[i]);
+
+		pthread_mutex_lock(&batch->out_lock);
+		if (!ok || !write_block(batch->out_fd, worker->line,
+								strlen(worker->line)))
+			batch->out_failed = true;
+		pthread_mutex_unlock(&batch->out_lock);
 	}
 
-	return lname;
+	free(worker->buffers.block);
+	free(worker->buffers.in_block);
+	free(worker->buffers.vals);
+	free(worker->line);
+
+	return NULL;
+}
+
+static int
+compare_paths(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
 }
 
 /*
- * Returns 'false' iff any empty clause appeared after assign.
+ * Collect paths of formulas: regular files of the directory, or lines of the
+ * list file. Empty lines and lines beginning with '#' are skipped.
+ *
+ * Returns false iff the directory or the list cannot be read. Error is
+ * reported.
  */
 static bool
-propagate_literal_value(Formula *formula, Assignment a)
+list_batch(const char *path, Batch *batch)
 {
-	Variable *v = &formula->variables[a.literal_name - 1];
-	v->assigned_value = a.newval;
-	bool	no_empty_clause = true;
+	struct stat st;
+	int			capacity = 0;
+	bool		ok = true;
 
-	for (int i = 0; i < v->nrelated_clauses; i++)
+	batch->paths = NULL;
+	batch->npaths = 0;
+
+	if (stat(path, &st) != 0)
 	{
-		Clause *c = v->related_clauses[i];
+		ereport("Cannot open batch");
+		return false;
+	}
 
-		if (c->n_in_use == 0)
-			continue;
+	if (S_ISDIR(st.st_mode))
+	{
+		DIR		   *dir;
+		struct dirent *entry;
 
-		for (int j = 0; j < c->n_literals; j++)
+		if ((dir = opendir(path)) == NULL)
+		{
+			ereport("Cannot open batch directory");
+			return false;
+		}
+
+		while (ok && (entry = readdir(dir)) != NULL)
 		{
-			if (c->literals[j].variable->name != a.literal_name)
+			char	   *file;
+
+			if (entry->d_name[0] == '.')
 				continue;
 
-			if (!LiteralIsInUse(&c->literals[j]))
+			if ((file = (char *) malloc(strlen(path) + strlen(entry->d_name) + 2)) == NULL)
+			{
+				ok = false;
+				break;
+			}
+			sprintf(file, "%s/%s", path, entry->d_name);
+
+			if (stat(file, &st) != 0 || !S_ISREG(st.st_mode))
+			{
+				free(file);
 				continue;
+			}
 
-			if (LiteralGivesTrue(&c->literals[j]))
-				delete_clause_from_formula(formula, c, a.stack_depth);
-			else
+			if (batch->npaths >= capacity)
 			{
-				if (clause_gives_false(c))
-					no_empty_clause = false;
-				LiteralSetUnused(&c->literals[j], a.stack_depth);
-				c->n_in_use -= 1;
+				char  **paths;
+
+				capacity = (capacity == 0) ? 64 : capacity * 2;
+				if ((paths = (char **) realloc(batch->paths,
+											   sizeof(char *) * capacity)) == NULL)
+				{
+					free(file);
+					ok = false;
+					break;
+				}
+				batch->paths = paths;
 			}
-			break;
+			batch->paths[batch->npaths++] = file;
 		}
+
+		closedir(dir);
+
+		/* Order of directory entries is arbitrary */
+		if (ok)
+			qsort(batch->paths, batch->npaths, sizeof(char *), compare_paths);
 	}
+	else
+	{
+		FILE	   *list;
+		char	   *line = NULL;
+		size_t		line_size = 0;
+		ssize_t		len;
 
-	return no_empty_clause;
-}
+		if ((list = fopen(path, "r")) == NULL)
+		{
+			ereport("Cannot open batch list");
+			return false;
+		}
 
+		while (ok && (len = getline(&line, &line_size, list)) >= 0)
+		{
+			while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+				line[--len] = '\0';
 
-static Assignment
-revert_literal_propagation(Formula *formula, AssignmentStack *stack)
-{
-	Assignment a;
+			if (len == 0 || line[0] == '#')
+				continue;
 
-	/* Revert unit propagations */
-	while (true)
-	{
-		a = peek(stack);
+			if (batch->npaths >= capacity)
+			{
+				char  **paths;
+
+				capacity = (capacity == 0) ? 64 : capacity * 2;
+				if ((paths = (char **) realloc(batch->paths,
+											   sizeof(char *) * capacity)) == NULL)
+				{
+					ok = false;
+					break;
+				}
+				batch->paths = paths;
+			}
 
-		if (a.type != UNIT_PROPAGATION)
-			break;
+			if ((batch->paths[batch->npaths] = strdup(line)) == NULL)
+				ok = false;
+			else
+				batch->npaths++;
+		}
 
-		a = pop(stack);
-		revert_change(formula, a);
+		free(line);
+		fclose(list);
 	}
 
-	a = pop(stack);
-
-	if (a.type != VAL_PROPAGATION)
+	if (!ok)
 	{
-		printf("Invalid assignment type in literal propagation reverting\n");
-		exit(1);
+		errno = 0;
+		ereport("Cannot allocate memory for batch");
 	}
 
-	revert_change(formula, a);
-
-	return a;
+	return ok;
 }
 
-static int
-dpll(FILE *file, int nclauses, int nvariables)
+/*
+ * Solve all formulas of the batch by 'options->nsolvers' threads. Results go
+ * to 'output_path', or to the standard output if it is NULL.
+ *
+ * Returns false iff the batch cannot be read or results cannot be written.
+ */
+static bool
+solve_batch(const char *batch_path, const char *output_path,
+			SolverOptions *options)
 {
-	int		val;
-	int		rc;
-	int		i = 0;
-	Formula	*formula;
-	int		cc = 0; /* current clause that is constructed */
-	int		nlits_in_clause = 0;
-	bool	init_clause = true;
-	AssignmentStack stack = {
-		.capacity = STACK_MAX_CAPACITY,
-		.depth = 0,
-		.data = NULL
-	};
-
-	if ((formula = create_formula(file, nclauses, nvariables)) == NULL)
-		return 0; /* Error message already emited */
+	Batch		batch;
+	BatchWorker *workers;
+	int			nworkers = options->nsolvers;
+	int			nstarted = 0;
 
-	if ((stack.data = (Assignment *)
-			malloc(sizeof(Assignment) * STACK_MAX_CAPACITY)) == NULL)
+	if (!list_batch(batch_path, &batch))
 	{
-		drop_formula(formula);
-		ereport_and_exit("Cannot allocate memory for assignment stack", 0);
+		for (int i = 0; i < batch.npaths; i++)
+			free(batch.paths[i]);
+		free(batch.paths);
+		return false;
 	}
 
+	batch.options = options;
+	batch.out_failed = false;
+	atomic_init(&batch.next, 0);
+	pthread_mutex_init(&batch.out_lock, NULL);
 
-	while (true)
+	if (output_path == NULL)
+		batch.out_fd = STDOUT_FILENO;
+	else if ((batch.out_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC,
+								  0644)) < 0)
 	{
-		unsigned int next_literal;
-		Assignment a;
-
-		a.literal_name = find_unassigned_literal(formula);
-		if (a.literal_name == InvalidLiteralName)
-		{
-			printf("SAT\n");
-			break;
-		}
-
-		a.oldval = VAL_UNASSIGNED;
-		a.newval = VAL_TRUE;
-		a.type = VAL_PROPAGATION;
-		push(&stack, &a);
+		ereport("Cannot open batch output");
+		batch.out_failed = true;
+		goto exit;
+	}
 
-		if (propagate_literal_value(formula, a))
-		{
-			if (unit_propagate(formula, &stack))
-				continue;
-		}
+	if (nworkers > batch.npaths)
+		nworkers = batch.npaths;
+	if (nworkers < 1)
+		nworkers = 1;
 
-		a = revert_literal_propagation(formula, &stack);
+	if ((workers = (BatchWorker *) calloc(nworkers, sizeof(BatchWorker))) == NULL)
+	{
+		errno = 0;
+		ereport("Cannot allocate memory for batch");
+		batch.out_failed = true;
+		goto exit;
+	}
 
-retry:
-		a.oldval = VAL_UNASSIGNED;
-		a.newval = VAL_FALSE;
-		a.type = VAL_PROPAGATION;
-		push(&stack, &a);
+	/* Messages printed so far go before the results */
+	fflush(stdout);
 
-		if (propagate_literal_value(formula, a))
-		{
-			if (unit_propagate(formula, &stack))
-				continue;
-		}
+	if (!write_block(batch.out_fd, BATCH_HEADER, strlen(BATCH_HEADER)))
+		batch.out_failed = true;
 
-		a = revert_literal_propagation(formula, &stack);
+	for (; nstarted < nworkers; nstarted++)
+	{
+		workers[nstarted].batch = &batch;
+		if (pthread_create(&workers[nstarted].thread, NULL, batch_worker_main,
+						   &workers[nstarted]) != 0)
+			break;
+	}
 
-		do
-		{
-			if (stack_is_empty(&stack))
-				break;
+	/* Without any thread all formulas are solved here */
+	if (nstarted == 0)
+	{
+		workers[0].batch = &batch;
+		batch_worker_main(&workers[0]);
+	}
 
-			a = revert_literal_propagation(formula, &stack);
-		} while (a.newval == VAL_FALSE);
+	for (int i = 0; i < nstarted; i++)
+		pthread_join(workers[i].thread, NULL);
 
-		if (stack_is_empty(&stack))
-		{
-			if (a.newval == VAL_TRUE)
-				goto retry;
+	free(workers);
 
-			printf("UNSAT\n");
-			break;
-		}
+	if (output_path != NULL && close(batch.out_fd) != 0)
+		batch.out_failed = true;
 
-		goto retry;
+	if (batch.out_failed)
+	{
+		errno = 0;
+		ereport("Cannot write batch results");
 	}
 
 exit:
-	drop_formula(formula);
-	free(stack.data);
+	pthread_mutex_destroy(&batch.out_lock);
+	for (int i = 0; i < batch.npaths; i++)
+		free(batch.paths[i]);
+	free(batch.paths);
 
-	return 1;
+	return !batch.out_failed;
 }
 
+/* Codes of long options, that have no short equivalent */
+enum
+{
+	OPT_RESTART_BASE = 256,
+	OPT_RESTART_FACTOR,
+	OPT_RESTART_MARGIN,
+	OPT_PARSE_ONLY,
+	OPT_CACHE,
+	OPT_PARSE_THREADS,
+	OPT_VERIFY,
+	OPT_PROOF,
+	OPT_PROOF_FORMAT,
+	OPT_THREADS,
+	OPT_NO_CLAUSE_SHARING,
+	OPT_CUBE_DEPTH,
+	OPT_BATCH,
+	OPT_BATCH_OUTPUT,
+};
+
 int main(int argc, char **argv)
 {
-	FILE			*file = NULL;
-	int				nclauses = 0;
+	DimacsReader	reader;
+	struct timespec	start;
+	bool			parse_only = false;
+	const char		*cache_path = NULL;
+	const char		*batch_path = NULL;
+	const char		*batch_output = NULL;
+	int				parse_threads = 0;
+	SolverResult	result;
 	int				ndisjunctions = 0;
 	int				nvariables = 0;
-	int				victim_idx = 0;
+	int				opt;
+	SolverOptions	options = {
+		.mode = SEARCH_DPLL,
+		.heuristic = HEURISTIC_VSIDS,
+		.static_counts = false,
+		.phase = PHASE_DEFAULT,
+		.phase_saving = true,
+		.seed = 1,
+		.restart = RESTART_LUBY,
+		.restart_base = 100,
+		.restart_factor = 1.5,
+		.restart_margin = 1.25,
+		.verify_model = false,
+		.proof_path = NULL,
+		.proof_format = PROOF_BINARY_DRAT,
+		.nsolvers = 1,
+		.share_clauses = true,
+		.cube_depth = 8,
+	};
+	static struct option long_options[] = {
+		{"mode", required_argument, NULL, 'm'},
+		{"heuristic", required_argument, NULL, 'H'},
+		{"phase", required_argument, NULL, 'p'},
+		{"no-phase-saving", no_argument, NULL, 'P'},
+		{"seed", required_argument, NULL, 's'},
+		{"restart", required_argument, NULL, 'r'},
+		{"restart-base", required_argument, NULL, OPT_RESTART_BASE},
+		{"restart-factor", required_argument, NULL, OPT_RESTART_FACTOR},
+		{"restart-margin", required_argument, NULL, OPT_RESTART_MARGIN},
+		{"parse-only", no_argument, NULL, OPT_PARSE_ONLY},
+		{"cache", required_argument, NULL, OPT_CACHE},
+		{"parse-threads", required_argument, NULL, OPT_PARSE_THREADS},
+		{"verify", no_argument, NULL, OPT_VERIFY},
+		{"proof", required_argument, NULL, OPT_PROOF},
+		{"proof-format", required_argument, NULL, OPT_PROOF_FORMAT},
+		{"threads", required_argument, NULL, OPT_THREADS},
+		{"no-clause-sharing", no_argument, NULL, OPT_NO_CLAUSE_SHARING},
+		{"cube-depth", required_argument, NULL, OPT_CUBE_DEPTH},
+		{"batch", required_argument, NULL, OPT_BATCH},
+		{"batch-output", required_argument, NULL, OPT_BATCH_OUTPUT},
+		{NULL, 0, NULL, 0},
+	};
+
+	while ((opt = getopt_long(argc, argv, "m:H:p:Ps:r:", long_options,
+							  NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'm':
+				if (strcmp(optarg, "dpll") == 0)
+					options.mode = SEARCH_DPLL;
+				else if (strcmp(optarg, "cdcl") == 0)
+					options.mode = SEARCH_CDCL;
+				else if (strcmp(optarg, "cube") == 0)
+					options.mode = SEARCH_CUBE;
+				else if (strcmp(optarg, "parallel-dpll") == 0)
+					options.mode = SEARCH_PARALLEL_DPLL;
+				else
+					ereport_and_exit("Unknown search mode", -1);
+				break;
+			case 'H':
+				/* Literal count heuristics may be prefixed with "static-" */
+				options.static_counts = (strncmp(optarg, "static-", 7) == 0);
+				if (options.static_counts)
+					optarg += 7;
+
+				if (strcmp(optarg, "first") == 0 && !options.static_counts)
+					options.heuristic = HEURISTIC_FIRST;
+				else if (strcmp(optarg, "vsids") == 0 && !options.static_counts)
+					options.heuristic = HEURISTIC_VSIDS;
+				else if (strcmp(optarg, "dlis") == 0)
+					options.heuristic = HEURISTIC_DLIS;
+				else if (strcmp(optarg, "moms") == 0)
+					options.heuristic = HEURISTIC_MOMS;
+				else if (strcmp(optarg, "jw") == 0)
+					options.heuristic = HEURISTIC_JW;
+				else
+					ereport_and_exit("Unknown decision heuristic", -1);
+				break;
+			case 'p':
+				if (strcmp(optarg, "true") == 0)
+					options.phase = PHASE_TRUE;
+				else if (strcmp(optarg, "false") == 0)
+					options.phase = PHASE_FALSE;
+				else if (strcmp(optarg, "random") == 0)
+					options.phase = PHASE_RANDOM;
+				else if (strcmp(optarg, "occurrence") == 0)
+					options.phase = PHASE_OCCURRENCE;
+				else
+					ereport_and_exit("Unknown phase policy", -1);
+				break;
+			case 'P':
+				options.phase_saving = false;
+				break;
+			case 's':
+				options.seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'r':
+				if (strcmp(optarg, "none") == 0)
+					options.restart = RESTART_NONE;
+				else if (strcmp(optarg, "luby") == 0)
+					options.restart = RESTART_LUBY;
+				else if (strcmp(optarg, "geometric") == 0)
+					options.restart = RESTART_GEOMETRIC;
+				else if (strcmp(optarg, "glucose") == 0)
+					options.restart = RESTART_GLUCOSE;
+				else
+					ereport_and_exit("Unknown restart policy", -1);
+				break;
+			case OPT_RESTART_BASE:
+				if ((options.restart_base = strtoul(optarg, NULL, 10)) == 0)
+					ereport_and_exit("Restart base must be positive", -1);
+				break;
+			case OPT_RESTART_FACTOR:
+				if ((options.restart_factor = strtod(optarg, NULL)) < 1.0)
+					ereport_and_exit("Restart factor must be at least 1", -1);
+				break;
+			case OPT_RESTART_MARGIN:
+				if ((options.restart_margin = strtod(optarg, NULL)) <= 0.0)
+					ereport_and_exit("Restart margin must be positive", -1);
+				break;
+			case OPT_PARSE_ONLY:
+				parse_only = true;
+				break;
+			case OPT_CACHE:
+				cache_path = optarg;
+				break;
+			case OPT_PARSE_THREADS:
+				if ((parse_threads = atoi(optarg)) < 0)
+					ereport_and_exit("Number of parse threads cannot be negative", -1);
+				break;
+			case OPT_VERIFY:
+				options.verify_model = true;
+				break;
+			case OPT_PROOF:
+				options.proof_path = optarg;
+				break;
+			case OPT_PROOF_FORMAT:
+				if (strcmp(optarg, "drat") == 0)
+					options.proof_format = PROOF_DRAT;
+				else if (strcmp(optarg, "binary-drat") == 0)
+					options.proof_format = PROOF_BINARY_DRAT;
+				else if (strcmp(optarg, "lrat") == 0)
+					options.proof_format = PROOF_LRAT;
+				else if (strcmp(optarg, "binary-lrat") == 0)
+					options.proof_format = PROOF_BINARY_LRAT;
+				else
+					ereport_and_exit("Unknown proof format", -1);
+				break;
+			case OPT_THREADS:
+				/* 0 is for a solver per online processor */
+				if ((options.nsolvers = atoi(optarg)) < 0)
+					ereport_and_exit("Number of threads cannot be negative", -1);
+				if (options.nsolvers == 0)
+					options.nsolvers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+				break;
+			case OPT_NO_CLAUSE_SHARING:
+				options.share_clauses = false;
+				break;
+			case OPT_CUBE_DEPTH:
+				if ((options.cube_depth = atoi(optarg)) < 0)
+					ereport_and_exit("Cube depth cannot be negative", -1);
+				break;
+			case OPT_BATCH:
+				batch_path = optarg;
+				break;
+			case OPT_BATCH_OUTPUT:
+				batch_output = optarg;
+				break;
+			default:
+				printf("Usage: %s [--mode=dpll|cdcl|cube|parallel-dpll] "
+					   "[--heuristic=first|vsids|[static-]dlis|[static-]moms|"
+					   "[static-]jw]\n"
+					   "\t[--phase=true|false|random|occurrence] "
+					   "[--no-phase-saving] [--seed=N]\n"
+					   "\t[--restart=none|luby|geometric|glucose] "
+					   "[--restart-base=N] [--restart-factor=F]\n"
+					   "\t[--restart-margin=F] [--parse-only] [--cache=FILE] "
+					   "[--parse-threads=N] [--verify]\n"
+					   "\t[--proof=FILE] "
+					   "[--proof-format=drat|binary-drat|lrat|binary-lrat]\n"
+					   "\t[--threads=N] [--no-clause-sharing] [--cube-depth=N]\n"
+					   "\t[--batch=DIR|LIST] [--batch-output=FILE] [<file>|-]\n", argv[0]);
+				return -1;
+		}
+	}
 
-	if (argc != 2)
+	/* Formula is read from the standard input without a file */
+	if (argc - optind > 1)
 		ereport_and_exit("Invalid arguments number", -1);
 
-	file = fopen(argv[1], "rb");
-	if (file == NULL)
-		ereport_and_exit("Cannot open file", -1);
+	/* Without learning there are no clauses to justify the answer */
+	if (options.proof_path != NULL && options.mode != SEARCH_CDCL)
+		ereport_and_exit("Proof can be written only in cdcl mode", -1);
+
+	/* Solvers of the portfolio would mix their clauses in a single proof */
+	if (options.proof_path != NULL && options.nsolvers > 1)
+		ereport_and_exit("Proof cannot be written by several threads", -1);
+
+	/* Threads of the batch are used for different formulas */
+	if (batch_path != NULL)
+	{
+		if (optind < argc)
+			ereport_and_exit("Invalid arguments number", -1);
+		if (options.proof_path != NULL || cache_path != NULL || parse_only)
+			ereport_and_exit("Batch cannot be used with proof, cache or parse-only", -1);
+		if (options.mode == SEARCH_CUBE || options.mode == SEARCH_PARALLEL_DPLL)
+			ereport_and_exit("Batch formulas are solved in dpll or cdcl mode", -1);
+
+		return solve_batch(batch_path, batch_output, &options) ? 0 : -1;
+	}
 
-	if (!skip_comments(file))
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (!reader_open(&reader, (optind < argc) ? argv[optind] : NULL, NULL))
 		return -1; /* Error message is already emited */
 
-	if (fscanf(file, "p cnf %d %d", &nvariables, &ndisjunctions) != 2)
-		ereport_and_exit("Cannot read configuration from file - wrong format", -1);
+	/*
+	 * Fresh cache is read instead of the file. Otherwise the file is parsed
+	 * and the cache is written along the way.
+	 */
+	if (cache_path != NULL)
+	{
+		if (!reader.is_regular || reader.is_cache)
+			ereport_and_exit("Cache can be made only from a regular DIMACS file", -1);
+
+		if (cache_is_fresh(cache_path, &reader))
+		{
+			reader_close(&reader);
+			if (!reader_open(&reader, cache_path, NULL))
+				return -1; /* Error message is already emited */
+		}
+		else
+			reader.cache_path = cache_path;
+	}
+
+	reader.parse_threads = parse_threads;
 
-	if (nvariables > 10000)
-		ereport_and_exit("Too many variables", -1);
+	if (!read_header(&reader, &nvariables, &ndisjunctions))
+		return -1; /* Error message is already emited */
 
-	if (!dpll(file, ndisjunctions, nvariables))
+	if (parse_only)
+	{
+		if (!benchmark_parse(&reader, ndisjunctions, nvariables, &start))
+			return -1; /* Error message is already emited */
+	}
+	else if ((result = dpll(&reader, ndisjunctions, nvariables,
+							&options)) == RESULT_ERROR)
 		return -1; /* Error message is already emited */
 
-	return 0;
+	reader_close(&reader);
+
+	/* Exit code tells the result, as in the SAT competition */
+	return parse_only ? 0 : result;
 }
@@ -0,0 +1,51 @@
+#!/bin/sh
+#
+# Solve formulas with known answers and compare exit codes (10 - satisfiable,
+# 20 - unsatisfiable) with the answer given by the first line of each
+# formula: "c expect SAT" or "c expect UNSAT". Each formula is solved once for
+# every line of 'runs', which holds options of the solver. Models are checked
+# by the solver itself.
+#
+# Usage: tests/check_known.sh [path to dpll binary]
+
+solver=${1:-./dpll}
+dir=$(dirname "$0")/known
+failed=0
+
+runs="--mode=dpll
+--mode=cdcl
+--mode=dpll --heuristic=dlis
+--mode=dpll --heuristic=moms
+--mode=cdcl --heuristic=jw
+--mode=cdcl --heuristic=static-moms
+--mode=cdcl --restart=luby --restart-base=1
+--mode=cdcl --restart=geometric --restart-base=1
+--mode=cdcl --restart=glucose
+--mode=dpll --threads=3
+--mode=cdcl --threads=3
+--mode=cube --threads=2
+--mode=cube --threads=3 --cube-depth=2
+--mode=parallel-dpll --threads=3
+--mode=parallel-dpll --threads=3 --heuristic=dlis"
+
+for cnf in "$dir"/*.cnf; do
+	case $(head -n 1 "$cnf") in
+		"c expect SAT") expected=10 ;;
+		"c expect UNSAT") expected=20 ;;
+		*) echo "$cnf: no expected answer"; failed=1; continue ;;
+	esac
+
+	while read -r options; do
+		$solver $options --verify "$cnf" < /dev/null > /dev/null 2>&1
+		result=$?
+		if [ $result -ne $expected ]; then
+			echo "$cnf $options: exit code $result, expected $expected"
+			failed=1
+		fi
+	done <<EOF
+$runs
+EOF
+done
+
+[ $failed -eq 0 ] && echo "All known answers match"
+exit $failed